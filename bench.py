@@ -0,0 +1,159 @@
+#!/usr/bin/env python
+#
+# bench.py - Measures how fast csim itself runs. For every trace and
+#     cache geometry it runs ./csim --bench, which times parsing and
+#     simulation separately, and reports accesses/sec, ns/access and
+#     peak RSS. Results are written as JSON and can be compared against
+#     a saved baseline to flag regressions.
+#
+#     linux> ./bench.py                          # long.trace + 10M synthetic
+#     linux> ./bench.py --sizes 10M,100M,1G      # bigger synthetic traces
+#     linux> ./bench.py --save-baseline          # record bench-baseline.json
+#     linux> ./bench.py --baseline bench-baseline.json
+#
+from __future__ import print_function
+import json
+import optparse
+import os
+import re
+import subprocess
+import sys
+
+# Representative geometries: direct mapped, 8-way and fully associative,
+# all 32-byte blocks
+GEOMETRIES = [
+    ("direct", 5, 1, 5),
+    ("8-way", 5, 8, 5),
+    ("fully-assoc", 0, 512, 5),
+]
+
+BENCH_DIR = ".bench"
+
+#
+# parseSize - turn "10M" or "1G" into an access count
+#
+def parseSize(text):
+    scale = {"K": 10**3, "M": 10**6, "G": 10**9}
+    text = text.strip().upper()
+    if text[-1] in scale:
+        return int(float(text[:-1]) * scale[text[-1]])
+    return int(text)
+
+#
+# synthTrace - write a reproducible synthetic trace of n accesses with
+# ./tracesynth: Zipf-distributed accesses over an 8MB working set, a hot
+# set with a long tail. Traces are generated once and reused.
+#
+def synthTrace(n):
+    path = os.path.join(BENCH_DIR, "synth-%d.trace" % n)
+    if os.path.exists(path):
+        return path
+    if not os.path.isdir(BENCH_DIR):
+        os.mkdir(BENCH_DIR)
+    print("Generating %s" % path)
+    tmp = path + ".tmp"
+    subprocess.check_call(["./tracesynth", "-p", "zipf", "-n", str(n), "-o", tmp])
+    os.rename(tmp, path)
+    return path
+
+#
+# runOne - run csim once and return its bench line as a dict
+#
+def runOne(trace, s, E, b):
+    cmd = ["./csim", "--bench", "-s", str(s), "-E", str(E), "-b", str(b), "-t", trace]
+    out = subprocess.check_output(cmd).decode()
+    m = re.search(r"bench accesses:(\d+) parse-sec:([\d.]+) sim-sec:([\d.]+) max-rss-kb:(\d+)", out)
+    if m is None:
+        sys.exit("Error: no bench line from: %s" % " ".join(cmd))
+    return {"accesses": int(m.group(1)), "parse_sec": float(m.group(2)),
+            "sim_sec": float(m.group(3)), "max_rss_kb": int(m.group(4))}
+
+#
+# bench - best of `repeat` runs for one trace and geometry
+#
+def bench(trace, geometry, repeat):
+    name, s, E, b = geometry
+    runs = [runOne(trace, s, E, b) for i in range(repeat)]
+    best = min(runs, key=lambda r: r["parse_sec"] + r["sim_sec"])
+    n = max(best["accesses"], 1)
+    total = best["parse_sec"] + best["sim_sec"]
+    return {
+        "trace": os.path.basename(trace),
+        "geometry": name,
+        "s": s, "E": E, "b": b,
+        "accesses": best["accesses"],
+        "parse_sec": best["parse_sec"],
+        "sim_sec": best["sim_sec"],
+        "accesses_per_sec": n / total if total > 0 else 0.0,
+        "parse_ns_per_access": best["parse_sec"] * 1e9 / n,
+        "sim_ns_per_access": best["sim_sec"] * 1e9 / n,
+        "max_rss_kb": max(r["max_rss_kb"] for r in runs),
+    }
+
+#
+# compare - flag every result whose ns/access grew by more than tolerance
+#
+def compare(results, baseline, tolerance):
+    old = dict(((r["trace"], r["geometry"]), r) for r in baseline)
+    regressions = 0
+    for r in results:
+        ref = old.get((r["trace"], r["geometry"]))
+        if ref is None:
+            continue
+        for field in ("parse_ns_per_access", "sim_ns_per_access"):
+            if ref[field] > 0 and r[field] > ref[field] * (1 + tolerance):
+                print("REGRESSION %s %s %s: %.1f -> %.1f ns/access" %
+                      (r["trace"], r["geometry"], field, ref[field], r[field]))
+                regressions += 1
+    return regressions
+
+def main():
+    p = optparse.OptionParser()
+    p.add_option("--sizes", dest="sizes", default="10M",
+                 help="comma separated synthetic trace sizes, e.g. 10M,100M,1G")
+    p.add_option("--repeat", dest="repeat", type="int", default=1,
+                 help="runs per configuration, the fastest is kept")
+    p.add_option("--out", dest="out", default="bench-results.json",
+                 help="where to write the JSON results")
+    p.add_option("--baseline", dest="baseline", default=None,
+                 help="baseline JSON to compare against")
+    p.add_option("--save-baseline", dest="save", action="store_true",
+                 help="also write the results to bench-baseline.json")
+    p.add_option("--tolerance", dest="tolerance", type="float", default=0.10,
+                 help="allowed slowdown before flagging a regression")
+    opts, args = p.parse_args()
+
+    traces = ["traces/long.trace"]
+    for size in opts.sizes.split(","):
+        if size:
+            traces.append(synthTrace(parseSize(size)))
+
+    results = []
+    print("%-22s%-13s%12s%12s%12s%12s" %
+          ("Trace", "Geometry", "Acc/sec", "Parse ns", "Sim ns", "RSS KB"))
+    for trace in traces:
+        for geometry in GEOMETRIES:
+            r = bench(trace, geometry, opts.repeat)
+            results.append(r)
+            print("%-22s%-13s%12.0f%12.1f%12.1f%12d" %
+                  (r["trace"], r["geometry"], r["accesses_per_sec"],
+                   r["parse_ns_per_access"], r["sim_ns_per_access"], r["max_rss_kb"]))
+            sys.stdout.flush()
+
+    out = open(opts.out, "w")
+    json.dump(results, out, indent=2)
+    out.close()
+    if opts.save:
+        out = open("bench-baseline.json", "w")
+        json.dump(results, out, indent=2)
+        out.close()
+
+    if opts.baseline:
+        baseline = json.load(open(opts.baseline))
+        if compare(results, baseline, opts.tolerance):
+            sys.exit(1)
+        print("No regressions against %s" % opts.baseline)
+
+# execute main only if called as a script
+if __name__ == "__main__":
+    main()
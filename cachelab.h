@@ -9,6 +9,7 @@
 
 typedef struct trans_func{
   void (*func_ptr)(int M,int N,int[N][M],int[M][N]);
+  void (*inplace_ptr)(int M,int N,int* A); /* set instead of func_ptr for in-place functions */
   char* description;
   char correct;
   unsigned int num_hits;
@@ -24,6 +25,9 @@ void printSummary(int hits,  /* number of  hits */
 				  int misses, /* number of misses */
 				  int evictions); /* number of evictions */
 
+/* printSummary for counts that can pass INT_MAX on very long traces */
+void printSummaryLong(long hits, long misses, long evictions);
+
 /* Fill the matrix with data */
 void initMatrix(int M, int N, int A[N][M], int B[M][N]);
 
@@ -34,4 +38,85 @@ void correctTrans(int M, int N, int A[N][M], int B[M][N]);
 void registerTransFunction(
     void (*trans)(int M,int N,int[N][M],int[M][N]), char* desc);
 
+/*
+ * In-place transposes take a single buffer holding A as N rows of M
+ * ints and leave A^T in it as M rows of N ints, so no B is needed.
+ */
+void registerInPlaceTransFunction(
+    void (*trans)(int M,int N,int* A), char* desc);
+
+/*
+ * Kernel registry - any loop over int matrices, not just transposes.
+ * A kernel is called as fn(M, N, args) where each args[i] points to the
+ * matrix described by the kernel's i-th argument descriptor, stored row
+ * major. Matrix dimensions are given as 'M', 'N' or '1' so they scale
+ * with the -M/-N test size. A reference function with the same
+ * signature computes the expected outputs.
+ */
+#define MAX_KERNELS 100
+#define MAX_KERNEL_ARGS 4
+
+#define KARG_IN 'i'     /* input, filled with small random values */
+#define KARG_OUT 'o'    /* output, compared against the reference */
+#define KARG_INDEX 'x'  /* input holding valid indexes into the first input */
+
+typedef struct kernel_arg{
+  char* name;           /* region name used by csim --regions */
+  char kind;            /* KARG_IN, KARG_OUT or KARG_INDEX */
+  char rows, cols;      /* 'M', 'N' or '1' */
+} kernel_arg_t;
+
+typedef struct kernel{
+  void (*func_ptr)(int M,int N,void* args[]);
+  void (*ref_ptr)(int M,int N,void* args[]);
+  char* description;
+  int num_args;
+  kernel_arg_t args[MAX_KERNEL_ARGS];
+  char correct;
+  unsigned int num_hits;
+  unsigned int num_misses;
+  unsigned int num_evictions;
+} kernel_t;
+
+/* Add the given kernel and its reference to the kernel list */
+void registerKernel(void (*fn)(int M,int N,void* args[]),
+                    void (*ref)(int M,int N,void* args[]), char* desc,
+                    int num_args, const kernel_arg_t args[]);
+
+/* Number of ints in a kernel argument at the given size */
+int kernelArgSize(const kernel_arg_t* arg, int M, int N);
+
+/* Rows and columns of a kernel argument at the given size */
+void kernelArgShape(const kernel_arg_t* arg, int M, int N, int* rows, int* cols);
+
+/*
+ * Binary traces - an 8 byte magic followed by one 64-bit record per data
+ * access, with the operation character ('L', 'S' or 'M') in the top byte
+ * and the address in the low 56 bits. Written by tracesynth, read by csim.
+ */
+#define BINARY_TRACE_MAGIC "CLTRACE1"
+#define BINARY_TRACE_MAGIC_LEN 8
+#define TRACE_RECORD(op, addr) \
+    (((unsigned long long)(op) << 56) | ((addr) & 0x00ffffffffffffffULL))
+#define TRACE_OP(rec) ((char)((rec) >> 56))
+#define TRACE_ADDR(rec) ((rec) & 0x00ffffffffffffffULL)
+
+/*
+ * Result store - simulation results cached on disk, keyed by a hash of
+ * the trace contents, the cache configuration and the simulator version.
+ * It is only used when the CSIM_STORE environment variable names a
+ * directory.
+ */
+#define RESULT_KEY_LEN 17
+
+/* Build the store key for a trace; returns 0 on success */
+int resultKey(const char* trace, const char* config, const char* version,
+              char key[RESULT_KEY_LEN]);
+
+/* Look up a stored result; returns 1 if found */
+int loadResult(const char* key, long* hits, long* misses, long* evictions);
+
+/* Record a result, atomically replacing any existing entry */
+void saveResult(const char* key, long hits, long misses, long evictions);
+
 #endif /* CACHELAB_TOOLS_H */
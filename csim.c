@@ -1,8 +1,32 @@
+#define _POSIX_C_SOURCE 200809L//clock_gettime under -std=c99
+#define _DEFAULT_SOURCE//MAP_ANONYMOUS and madvise
 #include "cachelab.h"
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <getopt.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <limits.h>
+#include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <errno.h>
+#endif
 
 /*
 	Nathan Walzer - nwalzer
@@ -10,21 +34,125 @@
 	Group: lnvarella-nwalzer
 */
 #define VALID 'T'
+#define CSIM_VERSION "csim-2"//bump whenever simulated results can change, it keys the result store
 #define INVALID 'F'
 
 struct block {
-    char valid;
     unsigned long tag;
     int LRU;
+    char valid;//last so the struct packs into 16 bytes
     //for the purposes of this assignment we can ignore the bytes that would be stored
 };
 
-struct block** alloCache(unsigned int s, int e){//allocates the cache to the correct size
-    struct block** tempCache = (struct block**) calloc(1<<s, sizeof(struct block));
-    if(tempCache == NULL) return NULL;
-    for(int i = 0; i < 1<<s; i++){
-	tempCache[i] = (struct block*) calloc(e, sizeof(struct block));
-        if(tempCache[i] == NULL) return NULL;
+/*
+	Arena for cache state. Tag arrays come out of a few large mmap'd chunks
+	instead of one calloc per set, which keeps them contiguous, lets the chunks
+	be backed by 2MB transparent huge pages, and gives a single release point.
+*/
+#define HUGE_PAGE (2UL << 20)
+#define CHUNK_MIN HUGE_PAGE
+//the most lines one simulated cache may have, 2^28 lines is already gigabytes of tags and LRU state
+#define MAX_LINES (1UL << 28)
+
+struct chunk {
+    struct chunk* next;
+    size_t size;//bytes mapped, including this header
+    size_t used;
+};
+
+struct arena {
+    struct chunk* chunks;//newest first
+    int huge;//ask for transparent huge pages
+    size_t mapped;
+    size_t used;
+    size_t failed;//size of the last allocation that could not be mapped
+};
+
+//map a new chunk of at least bytes including its header, 2MB aligned so huge pages can back it
+struct chunk* newChunk(size_t bytes, int huge){
+    size_t size = (bytes + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1);
+    char* raw = mmap(NULL, size + HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(raw == MAP_FAILED) return NULL;
+    //trim the unaligned head and the leftover tail
+    char* start = (char*)(((unsigned long) raw + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1));
+    if(start > raw) munmap(raw, start - raw);
+    if(start + size < raw + size + HUGE_PAGE) munmap(start + size, raw + size + HUGE_PAGE - (start + size));
+#ifdef MADV_HUGEPAGE
+    if(huge) madvise(start, size, MADV_HUGEPAGE);
+#endif
+    struct chunk* c = (struct chunk*) start;
+    c->size = size;
+    c->used = sizeof(struct chunk);
+    return c;
+}
+
+//bytes taken by count items of each bytes, SIZE_MAX (which no allocation can satisfy) if that overflows
+size_t arraySize(unsigned long count, size_t each){
+    return each != 0 && count > SIZE_MAX / each ? SIZE_MAX : count * each;
+}
+
+//zeroed, 64 byte aligned memory that lives until freeArena
+void* arenaAlloc(struct arena* a, size_t bytes){
+    if(bytes > SIZE_MAX - 2 * HUGE_PAGE){//rounding up below would wrap
+        a->failed = bytes;
+        return NULL;
+    }
+    bytes = (bytes + 63) & ~63UL;
+    struct chunk* c = a->chunks;
+    if(c == NULL || c->size - c->used < bytes){
+        c = newChunk(bytes + 64 < CHUNK_MIN ? CHUNK_MIN : bytes + 64, a->huge);
+        if(c == NULL){
+            a->failed = bytes;
+            return NULL;
+        }
+        c->used = (sizeof(struct chunk) + 63) & ~63UL;
+        c->next = a->chunks;
+        a->chunks = c;
+        a->mapped += c->size;
+    }
+    void* p = (char*) c + c->used;
+    c->used += bytes;
+    a->used += bytes;
+    return p;
+}
+
+void freeArena(struct arena* a){
+    while(a->chunks != NULL){
+        struct chunk* next = a->chunks->next;
+        munmap(a->chunks, a->chunks->size);
+        a->chunks = next;
+    }
+    a->mapped = a->used = 0;
+}
+
+//forget every allocation but keep the memory mapped, so a following run skips the page faults
+void resetArena(struct arena* a){
+    size_t header = (sizeof(struct chunk) + 63) & ~63UL;
+    if(a->chunks != NULL && a->chunks->next != NULL){
+        //several chunks can't be reused in place, so swap them for one that fits them all
+        size_t mapped = a->mapped;
+        freeArena(a);
+        a->chunks = newChunk(mapped, a->huge);
+        if(a->chunks == NULL) return;
+        a->chunks->used = header;
+        a->chunks->next = NULL;
+        a->mapped = a->chunks->size;
+        return;
+    }
+    if(a->chunks != NULL){
+        memset((char*) a->chunks + header, 0, a->chunks->used - header);
+        a->chunks->used = header;
+    }
+    a->used = 0;
+}
+
+//allocates the cache to the correct size, one contiguous array of lines behind the set pointers
+struct block** alloCache(struct arena* a, unsigned long sets, int e){
+    struct block** tempCache = (struct block**) arenaAlloc(a, arraySize(sets, sizeof(struct block*)));
+    struct block* lines = (struct block*) arenaAlloc(a, arraySize(sets, arraySize(e, sizeof(struct block))));
+    if(tempCache == NULL || lines == NULL) return NULL;//the caller's freeArena releases any partial state
+    for(unsigned long i = 0; i < sets; i++){
+	tempCache[i] = &lines[i * e];
 	for(int j = 0; j < e; j++){
 	    tempCache[i][j].valid = INVALID;
 	    tempCache[i][j].LRU = 0;
@@ -60,8 +188,8 @@ void place(struct block** cache, unsigned int set, int idx, unsigned long tag){
     return;
 }
 
-//evict the least recently used block and set its LRU count to 0
-void evict(struct block** cache, unsigned int set, int lines, unsigned long tag){
+//evict the least recently used block and set its LRU count to 0, return the victim's tag
+unsigned long evict(struct block** cache, unsigned int set, int lines, unsigned long tag){
     int maxLRU = 0;
     int mLRUIdx = 0;
     for(int i = 0; i < lines; i++){
@@ -70,7 +198,9 @@ void evict(struct block** cache, unsigned int set, int lines, unsigned long tag)
 	    mLRUIdx = i;
 	}
     }
+    unsigned long victim = cache[set][mLRUIdx].tag;
     place(cache, set, mLRUIdx, tag);
+    return victim;
 }
 
 //go through a given set and increment all of the LRUs
@@ -78,76 +208,2945 @@ void incLRU(struct block** cache, int set, int lines){
     for(int i = 0; i < lines; i++) cache[set][i].LRU++;
 }
 
-int main(int argc, char** argv){
+/*
+	Three-C miss classification. A shadow fully-associative LRU cache with the
+	same number of lines as the real one, plus a set of every block seen so far,
+	is run alongside the main model. A miss on a never-seen block is compulsory,
+	a miss the shadow cache also takes is capacity, and anything else is conflict.
+*/
+#define NONE -1
+#define EMPTY (~0UL)//free slot marker; block ~0 (b=0, the last byte of memory) is handled apart where it matters
+
+struct shadowLine {
+    unsigned long blk;
+    int prev;//towards most recently used
+    int next;//towards least recently used
+    int chain;//next line in the same hash bucket
+};
+
+struct shadow {
+    struct shadowLine* lines;
+    int cap;//total lines in the real cache
+    int used;
+    int head;//most recently used
+    int tail;//least recently used
+    int* buckets;
+    unsigned long bucketMask;
+    unsigned long* seen;//open addressed set of block numbers, EMPTY marks a free slot
+    unsigned long seenMask;
+    unsigned long seenCount;
+    int seenTop;//block EMPTY itself can't go in the table, so it is tracked here
+    long compulsory;
+    long capacity;
+    long conflict;
+};
+
+//mix all the bits of a block number so strided addresses still spread out
+unsigned long hashBlock(unsigned long blk){
+    blk ^= blk >> 33;
+    blk *= 0xff51afd7ed558ccdUL;
+    blk ^= blk >> 33;
+    return blk;
+}
+
+//smallest power of two that is >= n
+unsigned long roundPow2(unsigned long n){
+    unsigned long p = 1;
+    while(p < n) p <<= 1;
+    return p;
+}
+
+struct shadow* alloShadow(int cap){
+    if(cap <= 0 || (unsigned long) cap > MAX_LINES) return NULL;//keeps the sizes below from overflowing
+    struct shadow* sh = (struct shadow*) calloc(1, sizeof(struct shadow));
+    if(sh == NULL) return NULL;
+    sh->cap = cap;
+    sh->head = sh->tail = NONE;
+    sh->bucketMask = roundPow2(2 * (unsigned long) cap) - 1;
+    sh->seenMask = 1023;
+    sh->lines = (struct shadowLine*) malloc(cap * sizeof(struct shadowLine));
+    sh->buckets = (int*) malloc((sh->bucketMask + 1) * sizeof(int));
+    sh->seen = (unsigned long*) malloc((sh->seenMask + 1) * sizeof(unsigned long));
+    if(sh->lines == NULL || sh->buckets == NULL || sh->seen == NULL){
+        free(sh->lines);
+        free(sh->buckets);
+        free(sh->seen);
+        free(sh);
+        return NULL;
+    }
+    memset(sh->buckets, 0xff, (sh->bucketMask + 1) * sizeof(int));//every bucket NONE
+    memset(sh->seen, 0xff, (sh->seenMask + 1) * sizeof(unsigned long));//every slot EMPTY
+    return sh;
+}
+
+void freeShadow(struct shadow* sh){
+    if(sh == NULL) return;
+    free(sh->lines);
+    free(sh->buckets);
+    free(sh->seen);
+    free(sh);
+}
+
+//insert blk into the seen set, return 1 if it was already there
+int markSeen(struct shadow* sh, unsigned long blk){
+    unsigned long i = hashBlock(blk) & sh->seenMask;
+    if(blk == EMPTY){
+        int was = sh->seenTop;
+        sh->seenTop = 1;
+        return was;
+    }
+    while(sh->seen[i] != EMPTY){
+        if(sh->seen[i] == blk) return 1;
+        i = (i + 1) & sh->seenMask;
+    }
+    sh->seen[i] = blk;
+    if(++sh->seenCount * 2 > sh->seenMask){//keep the load under one half
+        unsigned long oldMask = sh->seenMask;
+        unsigned long* old = sh->seen;
+        unsigned long* grown = (unsigned long*) malloc(2 * (oldMask + 1) * sizeof(unsigned long));
+        if(grown == NULL){
+            //a full table would never end a probe, so the run can't go on
+            printf("out of memory for the set of seen blocks (%lu blocks)\n", sh->seenCount);
+            exit(1);
+        }
+        memset(grown, 0xff, 2 * (oldMask + 1) * sizeof(unsigned long));
+        sh->seen = grown;
+        sh->seenMask = 2 * oldMask + 1;
+        for(unsigned long j = 0; j <= oldMask; j++){
+            if(old[j] == EMPTY) continue;
+            unsigned long k = hashBlock(old[j]) & sh->seenMask;
+            while(sh->seen[k] != EMPTY) k = (k + 1) & sh->seenMask;
+            sh->seen[k] = old[j];
+        }
+        free(old);
+    }
+    return 0;
+}
+
+//unlink line idx from the recency list
+void shadowUnlink(struct shadow* sh, int idx){
+    struct shadowLine* l = &sh->lines[idx];
+    if(l->prev != NONE) sh->lines[l->prev].next = l->next; else sh->head = l->next;
+    if(l->next != NONE) sh->lines[l->next].prev = l->prev; else sh->tail = l->prev;
+}
+
+//make line idx the most recently used
+void shadowPush(struct shadow* sh, int idx){
+    sh->lines[idx].prev = NONE;
+    sh->lines[idx].next = sh->head;
+    if(sh->head != NONE) sh->lines[sh->head].prev = idx;
+    sh->head = idx;
+    if(sh->tail == NONE) sh->tail = idx;
+}
+
+//touch blk in the shadow cache, return 1 if it was resident
+int shadowAccess(struct shadow* sh, unsigned long blk){
+    int* bucket = &sh->buckets[hashBlock(blk) & sh->bucketMask];
+    int idx;
+    for(idx = *bucket; idx != NONE; idx = sh->lines[idx].chain){
+        if(sh->lines[idx].blk == blk){
+            shadowUnlink(sh, idx);
+            shadowPush(sh, idx);
+            return 1;
+        }
+    }
+    if(sh->used < sh->cap){
+        idx = sh->used++;
+    } else {
+        //recycle the least recently used line, removing it from its bucket first
+        idx = sh->tail;
+        shadowUnlink(sh, idx);
+        int* p = &sh->buckets[hashBlock(sh->lines[idx].blk) & sh->bucketMask];
+        while(*p != idx) p = &sh->lines[*p].chain;
+        *p = sh->lines[idx].chain;
+    }
+    sh->lines[idx].blk = blk;
+    sh->lines[idx].chain = *bucket;
+    *bucket = idx;
+    shadowPush(sh, idx);
+    return 0;
+}
+
+//feed one access to the shadow structures and classify it if the real cache missed
+void classify(struct shadow* sh, unsigned long blk, int hit){
+    int seen = markSeen(sh, blk);
+    int shadowHit = shadowAccess(sh, blk);
+    if(hit) return;
+    if(!seen) sh->compulsory++;
+    else if(!shadowHit) sh->capacity++;
+    else sh->conflict++;
+}
+
+/*
+	TLB model. Each TLB level is a set-associative LRU cache of virtual page
+	numbers, so it reuses the same block array and helpers as the data cache.
+*/
+struct tlb {
+    struct block** sets;
+    int s;//set index bits
+    int e;//ways per set
+    int pageBits;
+    long hits;
+    long misses;
+};
+
+//log2 of n if n is a power of two, otherwise -1
+int log2Exact(unsigned long n){
+    int bits = 0;
+    if(n == 0 || (n & (n - 1)) != 0) return -1;
+    while((1UL << bits) != n) bits++;
+    return bits;
+}
+
+//parse "<entries>:<ways>[:<page size>]" where page size is 4K, 2M or 1G, return 0 on success
+//the entries themselves are allocated later, once the arena is configured
+int parseTLB(char* arg, struct tlb* t, int defaultPageBits){
+    int entries, ways, sets;
+    char page[8] = "";
+    if(sscanf(arg, "%d:%d:%7s", &entries, &ways, page) < 2) return -1;
+    if(entries <= 0 || ways <= 0 || entries % ways != 0) return -1;
+    sets = entries / ways;
+    t->s = log2Exact(sets);
+    if(t->s < 0) return -1;
+    t->e = ways;
+    if(page[0] == '\0') t->pageBits = defaultPageBits;
+    else if(strcmp(page, "4K") == 0) t->pageBits = 12;
+    else if(strcmp(page, "2M") == 0) t->pageBits = 21;
+    else if(strcmp(page, "1G") == 0) t->pageBits = 30;
+    else return -1;
+    return 0;
+}
+
+//look up the page holding addr, filling it on a miss, return 1 on a hit
+int tlbAccess(struct tlb* t, unsigned long addr){
+    unsigned long vpn = addr >> t->pageBits;
+    unsigned int set = vpn & ~(0x7FFFFFFFFFFFFFFFL<<t->s);
+    unsigned long tag = vpn >> t->s;
+    int invalIdx;
+    incLRU(t->sets, set, t->e);
+    if(isHit(t->sets, set, tag, t->e)){
+        t->hits++;
+        return 1;
+    }
+    t->misses++;
+    invalIdx = anyInvalid(t->sets, set, t->e);
+    if(invalIdx != -1) place(t->sets, set, invalIdx, tag);
+    else evict(t->sets, set, t->e, tag);
+    return 0;
+}
+
+/*
+	Per data structure attribution. tracegen writes the address ranges of A, B
+	and the stack to .regions; every access and every eviction is charged to the
+	region holding the block, and evictions are also counted per set as
+	"evictor region evicts victim region".
+*/
+#define MAX_REGIONS 16
+
+struct regions {
+    int count;//named regions, index count is everything else
+    char names[MAX_REGIONS + 1][32];
+    unsigned long start[MAX_REGIONS];
+    unsigned long end[MAX_REGIONS];
+    int rows[MAX_REGIONS];//matrix shape when the file gives one, else 0
+    int cols[MAX_REGIONS];
+    long hits[MAX_REGIONS + 1];
+    long misses[MAX_REGIONS + 1];
+    long evictions[MAX_REGIONS + 1];
+    int* conflicts;//[set][evictor][victim]
+};
+
+//read "<name> <start hex> <end hex> [<rows> <cols>]" lines, return NULL if the file can't be used
+struct regions* loadRegions(char* path, unsigned long sets){
+    char line[256];
+    FILE* fp = fopen(path, "r");
+    if(fp == NULL) return NULL;
+    struct regions* r = (struct regions*) calloc(1, sizeof(struct regions));
+    if(r == NULL){
+        fclose(fp);
+        return NULL;
+    }
+    while(r->count < MAX_REGIONS && fgets(line, sizeof(line), fp) != NULL){
+        int i = r->count;
+        int n = sscanf(line, "%31s %lx %lx %d %d", r->names[i], &r->start[i], &r->end[i], &r->rows[i], &r->cols[i]);
+        if(n < 3) continue;
+        if(n < 5 || r->rows[i] <= 0 || r->cols[i] <= 0) r->rows[i] = r->cols[i] = 0;
+        r->count++;
+    }
+    fclose(fp);
+    strcpy(r->names[r->count], "other");
+    r->conflicts = (int*) calloc(sets * (r->count + 1) * (r->count + 1), sizeof(int));
+    if(r->conflicts == NULL){
+        free(r);
+        return NULL;
+    }
+    return r;
+}
+
+void freeRegions(struct regions* r){
+    if(r == NULL) return;
+    free(r->conflicts);
+    free(r);
+}
+
+//index of the region holding addr, or count for none
+int regionOf(struct regions* r, unsigned long addr){
+    for(int i = 0; i < r->count; i++){
+        if(addr >= r->start[i] && addr < r->end[i]) return i;
+    }
+    return r->count;
+}
+
+void printRegions(struct regions* r, unsigned long sets){
+    int n = r->count + 1;
+    for(int i = 0; i < n; i++){
+        printf("region %s hits:%ld misses:%ld evictions:%ld\n", r->names[i], r->hits[i], r->misses[i], r->evictions[i]);
+    }
+    //only sets where one region pushed out another are interesting
+    for(unsigned long set = 0; set < sets; set++){
+        int* m = &r->conflicts[set * n * n];
+        int printed = 0;
+        for(int i = 0; i < n; i++){
+            for(int j = 0; j < n; j++){
+                if(i == j || m[i * n + j] == 0) continue;
+                if(printed) printf(" | ");
+                else printf("set %lu: ", set);
+                printf("%s evicts %s %d", r->names[i], r->names[j], m[i * n + j]);
+                printed = 1;
+            }
+        }
+        if(printed) printf("\n");
+    }
+}
+
+/*
+	Set index functions. The default takes the low s bits of the block number.
+	The others model hashed and non power of two LLCs: xor folds every s-bit
+	chunk of the block number together, matrix computes set bit i as the parity
+	of the block number ANDed with row i of a user supplied bit matrix, and
+	prime takes the block number modulo any set count. Those three keep the
+	whole block number as the tag, since the set no longer determines the
+	remaining bits.
+*/
+#define INDEX_MODULO 0
+#define INDEX_XOR 1
+#define INDEX_MATRIX 2
+#define INDEX_PRIME 3
+
+struct indexFn {
+    int kind;
+    int s;
+    unsigned long sets;//only for INDEX_PRIME
+    unsigned long rows[64];//only for INDEX_MATRIX, one mask per set bit
+};
+
+//parse "xor", "matrix:<file>" or "prime:<sets>", return 0 on success
+int parseIndex(char* arg, struct indexFn* idx){
+    if(strcmp(arg, "xor") == 0){
+        idx->kind = INDEX_XOR;
+        return 0;
+    }
+    if(strncmp(arg, "prime:", 6) == 0){
+        idx->kind = INDEX_PRIME;
+        idx->sets = strtoul(arg + 6, NULL, 10);
+        return idx->sets > 0 ? 0 : -1;
+    }
+    if(strncmp(arg, "matrix:", 7) == 0){
+        //one hex mask per line, the first line produces set bit 0
+        FILE* fp = fopen(arg + 7, "r");
+        int i = 0;
+        if(fp == NULL) return -1;
+        while(i < 64 && fscanf(fp, "%lx", &idx->rows[i]) == 1) i++;
+        fclose(fp);
+        idx->kind = INDEX_MATRIX;
+        idx->s = i;//checked against -s once all options are read
+        return i > 0 ? 0 : -1;
+    }
+    return -1;
+}
+
+//set of one block number under a non-default index function
+unsigned long hashedSet(const struct indexFn* idx, unsigned long blk){
+    unsigned long set = 0;
+    if(idx->kind == INDEX_PRIME) return blk % idx->sets;
+    if(idx->kind == INDEX_XOR){
+        if(idx->s == 0) return 0;
+        for(; blk != 0; blk >>= idx->s) set ^= blk & ((1UL << idx->s) - 1);
+        return set;
+    }
+    for(int i = 0; i < idx->s; i++) set |= (unsigned long)(__builtin_popcountl(blk & idx->rows[i]) & 1) << i;
+    return set;
+}
+
+/*
+	Associativity independent lookup. Above a threshold associativity each set
+	gets a small hash table from tag to way, a doubly linked recency list and a
+	fill count in place of the age counters, so lookup, fill and victim
+	selection are O(1) whatever E is. Lines are never invalidated, so the free
+	ways of a set are simply used..E-1 and get filled lowest first, exactly as
+	anyInvalid would. The list tail is the line with the highest age counter.
+*/
+#define DEFAULT_WAY_INDEX_THRESHOLD 8
+
+struct wayIndex {
+    int e;
+    int nb;//hash buckets per set, a power of two
+    unsigned long* tags;//[set * e + way]
+    int* prev;//[set * e + way], towards most recently used
+    int* next;//[set * e + way], towards least recently used
+    int* chain;//[set * e + way], next way in the same bucket
+    int* head;//[set] most recently used way
+    int* tail;//[set] least recently used way
+    int* used;//[set] ways filled so far
+    int* buckets;//[set * nb + hash]
+};
+
+struct wayIndex* alloWayIndex(struct arena* a, unsigned long sets, int e){
+    struct wayIndex* w = (struct wayIndex*) arenaAlloc(a, sizeof(struct wayIndex));
+    if(w == NULL) return NULL;
+    w->e = e;
+    w->nb = (int) roundPow2(e);
+    w->tags = (unsigned long*) arenaAlloc(a, arraySize(sets, arraySize(e, sizeof(unsigned long))));
+    w->prev = (int*) arenaAlloc(a, arraySize(sets, arraySize(e, sizeof(int))));
+    w->next = (int*) arenaAlloc(a, arraySize(sets, arraySize(e, sizeof(int))));
+    w->chain = (int*) arenaAlloc(a, arraySize(sets, arraySize(e, sizeof(int))));
+    w->head = (int*) arenaAlloc(a, arraySize(sets, sizeof(int)));
+    w->tail = (int*) arenaAlloc(a, arraySize(sets, sizeof(int)));
+    w->used = (int*) arenaAlloc(a, arraySize(sets, sizeof(int)));//arena memory starts zeroed
+    w->buckets = (int*) arenaAlloc(a, arraySize(sets, arraySize(w->nb, sizeof(int))));
+    if(w->tags == NULL || w->prev == NULL || w->next == NULL || w->chain == NULL ||
+       w->head == NULL || w->tail == NULL || w->used == NULL || w->buckets == NULL) return NULL;
+    memset(w->head, 0xff, sets * sizeof(int));//every list empty (NONE)
+    memset(w->tail, 0xff, sets * sizeof(int));
+    memset(w->buckets, 0xff, sets * w->nb * sizeof(int));
+    return w;
+}
+
+//move way to the most recently used end of its set's list
+void wayTouch(struct wayIndex* w, unsigned long set, int way, int linked){
+    int* prev = &w->prev[set * w->e];
+    int* next = &w->next[set * w->e];
+    if(linked){
+        if(w->head[set] == way) return;
+        next[prev[way]] = next[way];//way isn't the head, so it has a prev
+        if(next[way] != NONE) prev[next[way]] = prev[way]; else w->tail[set] = prev[way];
+    }
+    prev[way] = NONE;
+    next[way] = w->head[set];
+    if(w->head[set] != NONE) prev[w->head[set]] = way; else w->tail[set] = way;
+    w->head[set] = way;
+}
+
+//look up and fill one line, return 1 on a hit and set *evicted/*victim on an eviction
+int wayAccess(struct wayIndex* w, unsigned long set, unsigned long tag, int* evicted, unsigned long* victim){
+    unsigned long base = set * w->e;
+    int* buckets = &w->buckets[set * w->nb];
+    int* bucket = &buckets[hashBlock(tag) & (w->nb - 1)];
+    int way;
+    for(way = *bucket; way != NONE; way = w->chain[base + way]){
+        if(w->tags[base + way] == tag){
+            wayTouch(w, set, way, 1);
+            return 1;
+        }
+    }
+    if(w->used[set] < w->e){
+        way = w->used[set]++;
+        wayTouch(w, set, way, 0);
+    } else {
+        //reuse the least recently used way, unhooking it from its bucket first
+        way = w->tail[set];
+        int* p = &buckets[hashBlock(w->tags[base + way]) & (w->nb - 1)];
+        while(*p != way) p = &w->chain[base + *p];
+        *p = w->chain[base + way];
+        *evicted = 1;
+        *victim = w->tags[base + way];
+        wayTouch(w, set, way, 1);
+    }
+    w->tags[base + way] = tag;
+    w->chain[base + way] = *bucket;
+    *bucket = way;
+    return 0;
+}
+
+/*
+	Latency model. Every access pays the hit latency; a miss also pays the
+	memory latency and evicting a dirty line pays the writeback cost, both
+	divided by the memory-level parallelism (how many misses overlap on
+	average). Page walks from the TLB model are added at walk-cost each.
+	Dirty lines are tracked by block number in an open addressing set that
+	only ever holds resident blocks, so it needs no more slots than there are
+	lines and works the same for the age-counter and hashed-way layouts.
+*/
+struct latency {
+    int hit;//cycles for a hit in the simulated cache
+    int mem;//extra cycles to fetch a block from memory
+    int wb;//extra cycles to write a dirty block back
+    double mlp;//average number of overlapping misses, 1 is fully serial
+    long writebacks;
+    unsigned long* dirty;//EMPTY or a dirty resident block
+    unsigned long mask;
+};
+
+//parse <hit>:<mem>[:<wb>[:<mlp>]], return 0 on success
+int parseLatency(char* arg, struct latency* lat){
+    lat->wb = 0;
+    lat->mlp = 1;
+    int n = sscanf(arg, "%d:%d:%d:%lf", &lat->hit, &lat->mem, &lat->wb, &lat->mlp);
+    if(n < 2 || lat->hit < 0 || lat->mem < 0 || lat->wb < 0 || lat->mlp < 1) return -1;
+    return 0;
+}
+
+int alloDirty(struct arena* a, struct latency* lat, unsigned long lines){
+    unsigned long cap = roundPow2(2 * lines);
+    lat->dirty = (unsigned long*) arenaAlloc(a, arraySize(cap, sizeof(unsigned long)));
+    if(lat->dirty == NULL) return -1;
+    memset(lat->dirty, 0xff, cap * sizeof(unsigned long));//every slot EMPTY
+    lat->mask = cap - 1;
+    return 0;
+}
+
+void markDirty(struct latency* lat, unsigned long blk){
+    unsigned long i = hashBlock(blk) & lat->mask;
+    while(lat->dirty[i] != EMPTY){
+        if(lat->dirty[i] == blk) return;
+        i = (i + 1) & lat->mask;
+    }
+    lat->dirty[i] = blk;
+}
+
+//forget an evicted block, return 1 if it was dirty
+int cleanVictim(struct latency* lat, unsigned long blk){
+    unsigned long i = hashBlock(blk) & lat->mask, j, home;
+    while(lat->dirty[i] != blk){
+        if(lat->dirty[i] == EMPTY) return 0;
+        i = (i + 1) & lat->mask;
+    }
+    //backward shift deletion keeps every probe chain unbroken
+    for(j = (i + 1) & lat->mask; lat->dirty[j] != EMPTY; j = (j + 1) & lat->mask){
+        home = hashBlock(lat->dirty[j]) & lat->mask;
+        if(((j - home) & lat->mask) >= ((j - i) & lat->mask)){
+            lat->dirty[i] = lat->dirty[j];
+            i = j;
+        }
+    }
+    lat->dirty[i] = EMPTY;
+    return 1;
+}
+
+/*
+	Victim and miss caches. A small fully associative buffer sits beside the
+	main cache and is only consulted when the main cache misses. A victim
+	cache holds the lines the main cache evicts: a main miss that finds its
+	block there swaps it back for the line just evicted. A miss cache instead
+	keeps a copy of every block fetched on a miss. Either way the main cache
+	is simulated exactly as before, so its counts don't change; the buffer
+	reports how many of those misses it would have caught, which is how far a
+	hardware buffer absorbs conflict misses (the diagonal and power of two
+	strides that trans.c works around) without any change to the code.
+	With --latency a victim cache owns the dirty lines it takes in: they are
+	written back when the buffer pushes them out, not when the main cache
+	evicts them, and a dirty line swapped back is dirty again in the cache.
+	A miss cache only holds copies, so it never changes the writebacks.
+*/
+#define BUFFER_VICTIM 0
+#define BUFFER_MISS 1
+
+struct buffer {
+    int kind;
+    int entries;
+    unsigned long* blk;//EMPTY or a block number
+    unsigned long* stamp;//LRU order, larger is more recent
+    char* dirty;//1 if the entry holds a line the main cache evicted dirty
+    struct latency* lat;//NULL unless --latency counts writebacks
+    unsigned long clock;
+    long hits;//main cache misses caught, swaps for a victim cache
+    long misses;
+    long evictions;//lines pushed out of the buffer
+};
+
+//parse the entry count for --victim-cache or --miss-cache, return 0 on success
+int parseBuffer(char* arg, int kind, struct buffer* buf){
+    buf->kind = kind;
+    buf->entries = atoi(arg);
+    return buf->entries > 0 ? 0 : -1;
+}
+
+int alloBuffer(struct arena* a, struct buffer* buf){
+    buf->blk = (unsigned long*) arenaAlloc(a, buf->entries * sizeof(unsigned long));
+    buf->stamp = (unsigned long*) arenaAlloc(a, buf->entries * sizeof(unsigned long));
+    buf->dirty = (char*) arenaAlloc(a, buf->entries);
+    if(buf->blk == NULL || buf->stamp == NULL || buf->dirty == NULL) return -1;
+    memset(buf->blk, 0xff, buf->entries * sizeof(unsigned long));//every entry EMPTY
+    memset(buf->stamp, 0, buf->entries * sizeof(unsigned long));
+    memset(buf->dirty, 0, buf->entries);
+    buf->clock = buf->hits = buf->misses = buf->evictions = 0;
+    return 0;
+}
+
+//put blk in the least recently used (or an empty) entry, writing back a dirty line pushed out
+void bufferFill(struct buffer* buf, unsigned long blk, int dirty){
+    int lru = 0;
+    for(int i = 1; i < buf->entries && buf->blk[lru] != EMPTY; i++){
+        if(buf->blk[i] == EMPTY || buf->stamp[i] < buf->stamp[lru]) lru = i;
+    }
+    if(buf->blk[lru] != EMPTY){
+        buf->evictions++;
+        if(buf->dirty[lru] && buf->lat != NULL) buf->lat->writebacks++;
+    }
+    buf->blk[lru] = blk;
+    buf->dirty[lru] = dirty;
+    buf->stamp[lru] = ++buf->clock;
+}
+
+//a main cache miss on blk that evicted victim (EMPTY if nothing, dirty if victimDirty), return 1 if the buffer had blk
+int bufferAccess(struct buffer* buf, unsigned long blk, unsigned long victim, int victimDirty){
+    for(int i = 0; i < buf->entries; i++){
+        if(buf->blk[i] != blk) continue;
+        buf->hits++;
+        if(buf->kind == BUFFER_VICTIM){
+            //swap: the block goes back to the main cache and its victim takes the entry
+            if(buf->dirty[i] && buf->lat != NULL) markDirty(buf->lat, blk);
+            buf->blk[i] = victim;
+            buf->dirty[i] = victimDirty;
+            if(victim == EMPTY) return 1;
+        }
+        buf->stamp[i] = ++buf->clock;
+        return 1;
+    }
+    buf->misses++;
+    if(buf->kind == BUFFER_MISS) bufferFill(buf, blk, 0);
+    else if(victim != EMPTY) bufferFill(buf, victim, victimDirty);
+    return 0;
+}
+
+/*
+	Profiling. --profile reports wall time per phase of a run: open (option
+	parsing, trace open and cache allocation), parse, decode, simulate and
+	report. On Linux the simulate phase is also measured with perf_event
+	counters, one group enabled around every simBatch call on the simulating
+	thread, so parsing never leaks into them. Counters the kernel or the
+	hardware refuses are left out and reported as missing.
+*/
+#define PERF_EVENTS 4
+
+//seconds spent in each phase of a run
+struct phases {
+    double open;
+    double parse;
+    double decode;
+    double sim;
+    double report;
+};
+
+struct perf {
+    int leader;//-1 when no counter could be opened
+    int fds[PERF_EVENTS];
+    unsigned long long values[PERF_EVENTS];
+    int error;//errno of the first counter that failed to open, -1 off Linux
+};
+
+static const char* perfNames[PERF_EVENTS] = {"cycles", "instructions", "llc-misses", "branch-misses"};
+static const char* perfJsonNames[PERF_EVENTS] = {"cycles", "instructions", "llc_misses", "branch_misses"};
+
+//open whichever counters this machine allows, return 0 if at least one opened
+int perfOpen(struct perf* p){
+    p->leader = -1;
+    p->error = 0;
+    for(int i = 0; i < PERF_EVENTS; i++){
+        p->fds[i] = -1;
+        p->values[i] = 0;
+    }
+#ifdef __linux__
+    static const unsigned long long configs[PERF_EVENTS] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+    for(int i = 0; i < PERF_EVENTS; i++){
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[i];
+        attr.disabled = p->leader < 0;//members follow the leader
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        int fd = (int) syscall(SYS_perf_event_open, &attr, 0, -1, p->leader, 0);
+        if(fd < 0){
+            if(p->error == 0) p->error = errno;
+            continue;
+        }
+        p->fds[i] = fd;
+        if(p->leader < 0) p->leader = fd;
+    }
+#else
+    p->error = -1;
+#endif
+    return p->leader >= 0 ? 0 : -1;
+}
+
+void perfToggle(struct perf* p, int on){
+#ifdef __linux__
+    if(p->leader >= 0) ioctl(p->leader, on ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+void perfClose(struct perf* p){
+    for(int i = 0; i < PERF_EVENTS; i++){
+        if(p->fds[i] < 0) continue;
+        if(read(p->fds[i], &p->values[i], sizeof(p->values[i])) != sizeof(p->values[i])) p->values[i] = 0;
+        close(p->fds[i]);
+    }
+}
+
+//one key:value line for people and scripts, plus the same as JSON when asked
+void printProfile(const struct phases* ph, const struct perf* p, long accesses, FILE* json){
+    printf("profile open-sec:%.6f parse-sec:%.6f decode-sec:%.6f sim-sec:%.6f report-sec:%.6f",
+           ph->open, ph->parse, ph->decode, ph->sim, ph->report);
+    if(p->leader < 0) printf(" perf:unavailable perf-errno:%d", p->error);
+    for(int i = 0; i < PERF_EVENTS; i++){
+        if(p->fds[i] >= 0) printf(" %s:%llu", perfNames[i], p->values[i]);
+    }
+    if(p->fds[0] >= 0 && p->fds[1] >= 0 && p->values[0] > 0)
+        printf(" ipc:%.2f", (double) p->values[1] / p->values[0]);
+    printf("\n");
+    if(json == NULL) return;
+    fprintf(json, "{\"accesses\": %ld, \"open_sec\": %.6f, \"parse_sec\": %.6f, \"decode_sec\": %.6f, "
+            "\"sim_sec\": %.6f, \"report_sec\": %.6f",
+            accesses, ph->open, ph->parse, ph->decode, ph->sim, ph->report);
+    for(int i = 0; i < PERF_EVENTS; i++){
+        if(p->fds[i] >= 0) fprintf(json, ", \"%s\": %llu", perfJsonNames[i], p->values[i]);
+        else fprintf(json, ", \"%s\": null", perfJsonNames[i]);
+    }
+    if(p->leader < 0) fprintf(json, ", \"perf_errno\": %d", p->error);
+    fprintf(json, "}\n");
+}
+
+/*
+	Simulation state. Everything one run needs lives here so the access loop
+	is a single function call per parsed record.
+*/
+struct sim {
     int s;
     int e;
     int b;
-    int opt;
-    int hits = 0;
-    int miss = 0;
-    int evic = 0;
-    unsigned int set;
-    struct block** cache;
-    FILE *t;
-    
-    while((opt = getopt(argc, argv, "s:E:b:t:")) != -1){
-	switch(opt){
-	case 's':
-	    s = atoi(optarg);
-	    break;
-	case 'E':
-	    e = atoi(optarg);
-	    break;
-	case 'b':
-	    b = atoi(optarg);
-	    break;
-	case 't':
-	    t = fopen(optarg, "r");
-		printf("%s", optarg);
-	    break;
-	case '?': //if we get unexpected input abort program
-	    return 0;
-	default:
-	    break;
-	}
+    unsigned long sets;//1<<s unless the index function says otherwise
+    struct indexFn index;
+    struct block** cache;//NULL when ways is used instead
+    struct wayIndex* ways;//NULL unless E is above wayThreshold
+    int wayThreshold;
+    int runSkip;//count same-block repeats as hits without touching set state
+    long hits;//long: billion-access traces count M records twice
+    long miss;
+    long evic;
+    struct shadow* sh;//NULL unless classifying misses
+    struct tlb tlb1;//tlb1.sets is NULL unless modelling a TLB
+    struct tlb tlb2;
+    int walkCost;
+    long walks;
+    struct regions* regions;//NULL unless attributing to data structures
+    struct series* series;//NULL unless writing a time series
+    struct latency* lat;//NULL unless estimating cycles
+    struct buffer* buf;//NULL unless modelling a victim or miss cache
+    struct perf* perf;//NULL unless counting the simulate phase
+};
+
+//describe the geometry for result keys; a matrix is named by its rows, not its file, so edits are noticed
+void configString(char* out, size_t size, const struct sim* sim, const char* indexName){
+    if(sim->index.kind == INDEX_MATRIX){
+        unsigned long h = sim->index.s;
+        for(int i = 0; i < sim->index.s; i++) h = hashBlock(h ^ sim->index.rows[i]) + i;
+        snprintf(out, size, "s=%d E=%d b=%d index=matrix:%016lx", sim->s, sim->e, sim->b, h);
+        return;
     }
-    //s = atoi(argv[2]);
-    //e = atoi(argv[4]);
-    //b = atoi(argv[6]);
-    //t = fopen(argv[8], "r");
-    if(t == NULL) return 0; //if the file didn't open exit the program
-    cache = alloCache(s, e);
-    if(cache == NULL) return 0; //if the cache wasn't allocated exit the program
+    snprintf(out, size, "s=%d E=%d b=%d%s%s", sim->s, sim->e, sim->b,
+             indexName ? " index=" : "", indexName ? indexName : "");
+}
+
+#define BATCH 16384//records parsed before they are simulated
 
-    char* op = malloc(8);
+//parsed trace records as parallel arrays, set, tag and same are filled in by decodeBatch
+struct batch {
+    int n;
+    char op[BATCH];
+    unsigned char same[BATCH];//1 when the record touches the same block as the one before it
+    unsigned long addr[BATCH];
+    unsigned long set[BATCH];
+    unsigned long tag[BATCH];
+};
+
+//read up to max data accesses from the trace, skipping instruction loads, return how many were read
+int parseBatch(FILE* t, struct batch* batch, int max){
+    char op[8];
+    char after[32];
     unsigned long addr;
-    char* after = malloc(8);
-    int invalIdx;
-    while (fscanf(t, "%s", op) != EOF){ //get the type of instruction (I, M, S, L)
+    int n = 0;
+    while(n < max && fscanf(t, "%7s", op) != EOF){ //get the type of instruction (I, M, S, L)
         fscanf(t, "%lx", &addr); //get the address
-    	fscanf(t, "%s", after); //unused space after the address
-	if(op[0] == 'I') continue; //if it's an instruction argument then ignore
-	addr = addr>>b;//ignore the offset bits
-	set = addr & ~(0x7FFFFFFFFFFFFFFFL<<s);//isolate the set bits
-	addr = addr>>s;//addr now becomes tag bits
-	incLRU(cache, set, e);//increment all LRUs
-	if(op[0] == 'M') hits++;//"M" always guarentees at least one hit
-	if(isHit(cache, set, addr, e)){//if it is a hit then increment hits and restart the loop
-	    hits++;
-	    continue;
-	}
-	miss++;//if not a hit, then inc miss
-	invalIdx = anyInvalid(cache, set, e);//Place block in invalid line before evicting other lines
-	if(invalIdx != -1){
-	    //if invalIdx returns an index, place this block in that postiion
-	    place(cache, set, invalIdx, addr);
-	} else {
-	    //otherwise we must evict the highest LRU
-	    evic++;
-	    evict(cache, set, e, addr);
-	}
+        fscanf(t, "%31s", after); //unused space after the address
+        if(op[0] == 'I') continue; //if it's an instruction argument then ignore
+        batch->op[n] = op[0];
+        batch->addr[n] = addr;
+        n++;
+    }
+    return n;
+}
+
+//read up to max records from a binary trace whose magic has already been consumed
+int parseBinaryBatch(FILE* t, struct batch* batch, int max){
+    unsigned long long recs[1024];
+    int n = 0;
+    while(n < max){
+        int want = max - n < 1024 ? max - n : 1024;
+        int got = fread(recs, sizeof(recs[0]), want, t);
+        for(int i = 0; i < got; i++){
+            batch->op[n] = TRACE_OP(recs[i]);
+            batch->addr[n] = TRACE_ADDR(recs[i]);
+            n++;
+        }
+        if(got < want) break;
+    }
+    return n;
+}
+
+//return 1 and consume the magic if t is a binary trace, otherwise rewind to the start
+int isBinaryTrace(FILE* t){
+    char magic[BINARY_TRACE_MAGIC_LEN];
+    if(fread(magic, 1, BINARY_TRACE_MAGIC_LEN, t) == BINARY_TRACE_MAGIC_LEN &&
+       memcmp(magic, BINARY_TRACE_MAGIC, BINARY_TRACE_MAGIC_LEN) == 0) return 1;
+    rewind(t);
+    return 0;
+}
+
+/*
+	Decoding runs over a whole batch ahead of simulation: set and tag come from
+	two SSE2 shifts and a mask per pair of addresses, then a second flat loop
+	marks records that touch the same block as their predecessor. prevBlk
+	carries the last block of one batch into the next and starts out as ~0,
+	which never marks a repeat: with b=0 that is also a real block, and a
+	missed repeat only costs a full update while a false one would be a wrong hit.
+*/
+void decodeBatch(struct batch* batch, int n, int s, int b, const struct indexFn* idx, unsigned long* prevBlk){
+    unsigned long mask = (1UL<<s) - 1;//isolates the set bits
+    int i = 0;
+    batch->n = n;
+    if(idx->kind != INDEX_MODULO){
+        //hashed indexing gets its own loop so the default path stays untouched
+        for(; i < n; i++){
+            unsigned long blk = batch->addr[i]>>b;
+            batch->set[i] = hashedSet(idx, blk);
+            batch->tag[i] = blk;
+        }
+    }
+#ifdef __SSE2__
+    __m128i bShift = _mm_cvtsi32_si128(b);
+    __m128i sShift = _mm_cvtsi32_si128(s);
+    __m128i vMask = _mm_set1_epi64x(mask);
+    for(; i + 2 <= n; i += 2){
+        __m128i blk = _mm_srl_epi64(_mm_loadu_si128((__m128i*) &batch->addr[i]), bShift);
+        _mm_storeu_si128((__m128i*) &batch->set[i], _mm_and_si128(blk, vMask));
+        _mm_storeu_si128((__m128i*) &batch->tag[i], _mm_srl_epi64(blk, sShift));
+    }
+#endif
+    for(; i < n; i++){
+        unsigned long blk = batch->addr[i]>>b;//ignore the offset bits
+        batch->set[i] = blk & mask;
+        batch->tag[i] = blk>>s;//the rest are tag bits
+    }
+    if(n == 0) return;
+    batch->same[0] = *prevBlk != ~0UL && (batch->addr[0]>>b) == *prevBlk;
+    for(i = 1; i < n; i++) batch->same[i] = (batch->addr[i]>>b) == (batch->addr[i-1]>>b);
+    *prevBlk = batch->addr[n-1]>>b;
+}
+
+//look up and fill one line of the age-counter cache, return 1 on a hit and set *evicted/*victim on an eviction
+int cacheAccess(struct sim* sim, unsigned long set, unsigned long tag, int* evicted, unsigned long* victim){
+    int invalIdx;
+    incLRU(sim->cache, set, sim->e);//increment all LRUs
+    if(isHit(sim->cache, set, tag, sim->e)) return 1;
+    invalIdx = anyInvalid(sim->cache, set, sim->e);//Place block in invalid line before evicting other lines
+    if(invalIdx != -1){
+        //if invalIdx returns an index, place this block in that postiion
+        place(sim->cache, set, invalIdx, tag);
+    } else {
+        //otherwise we must evict the highest LRU
+        *evicted = 1;
+        *victim = evict(sim->cache, set, sim->e, tag);
+    }
+    return 0;
+}
+
+/*
+	Same-block runs. A record that touches the block of the record right before
+	it must hit, since that block is the most recently used line of its set.
+	Touching it again only moves it from most recently used to most recently
+	used: the age counters of the other lines all go up by one but keep their
+	order, so every later LRU decision is unchanged. Such records are counted
+	without going near the set. The same holds for the TLB (same page) and the
+	shadow cache, which are skipped too.
+*/
+//count a same-block repeat, return 0 if the state has to be updated after all
+int simRepeat(struct sim* sim, char op, unsigned long addr, int region){
+    if(sim->tlb1.sets != NULL){
+        if(sim->tlb1.pageBits < sim->b) return 0;//a block can span pages
+        sim->tlb1.hits += 1 + (op == 'M');
+    }
+    sim->hits += 1 + (op == 'M');
+    if(sim->regions != NULL) sim->regions->hits[region] += 1 + (op == 'M');
+    if(sim->lat != NULL && op != 'L') markDirty(sim->lat, addr>>sim->b);
+    return 1;
+}
+
+//simulate one decoded data access, same is its flag from decodeBatch
+void simAccess(struct sim* sim, char op, unsigned long addr, unsigned long set, unsigned long tag, int same){
+    unsigned long victim = 0;
+    int evicted = 0, victimDirty = 0;
+    int hit;
+    int region = 0;
+    if(sim->regions != NULL) region = regionOf(sim->regions, addr);
+    if(same && sim->runSkip && simRepeat(sim, op, addr, region)) return;
+    if(sim->tlb1.sets != NULL){
+        //translate first, a miss in every level costs a page walk
+        if(!tlbAccess(&sim->tlb1, addr) && (sim->tlb2.sets == NULL || !tlbAccess(&sim->tlb2, addr))) sim->walks++;
+        if(op == 'M') sim->tlb1.hits++;//the store half of "M" hits the same page
+    }
+    if(sim->ways != NULL) hit = wayAccess(sim->ways, set, tag, &evicted, &victim);
+    else hit = cacheAccess(sim, set, tag, &evicted, &victim);
+    if(op == 'M'){//"M" always guarentees at least one hit
+        sim->hits++;
+        if(sim->regions != NULL) sim->regions->hits[region]++;
+    }
+    if(sim->sh != NULL) classify(sim->sh, addr>>sim->b, hit);
+    if(sim->lat != NULL){
+        //the victim leaves before the new block can be dirtied
+        victimDirty = evicted && cleanVictim(sim->lat, sim->index.kind == INDEX_MODULO ? (victim << sim->s) | set : victim);
+        //a victim cache takes the dirty line over and writes it back when it pushes it out
+        if(victimDirty && (sim->buf == NULL || sim->buf->kind != BUFFER_VICTIM)) sim->lat->writebacks++;
+        if(op != 'L') markDirty(sim->lat, addr>>sim->b);
+    }
+    if(hit){//if it is a hit then increment hits and return
+        sim->hits++;
+        if(sim->regions != NULL) sim->regions->hits[region]++;
+        return;
+    }
+    sim->miss++;//if not a hit, then inc miss
+    if(sim->regions != NULL) sim->regions->misses[region]++;
+    if(sim->buf != NULL){
+        unsigned long victimBlk = sim->index.kind == INDEX_MODULO ? (victim << sim->s) | set : victim;
+        bufferAccess(sim->buf, addr>>sim->b, evicted ? victimBlk : EMPTY, victimDirty);
+    }
+    if(!evicted) return;
+    sim->evic++;
+    if(sim->regions != NULL){
+        struct regions* r = sim->regions;
+        int n = r->count + 1;
+        unsigned long victimBlk = sim->index.kind == INDEX_MODULO ? (victim << sim->s) | set : victim;
+        int victimRegion = regionOf(r, victimBlk << sim->b);
+        r->evictions[region]++;
+        r->conflicts[((size_t) set * n + region) * n + victimRegion]++;
     }
+}
+
+/*
+	Interval time series. Counts are emitted as deltas every N accesses and/or
+	whenever a marker address from tracegen's .marker file is touched, as CSV or
+	as fixed 32 byte binary records. A phase change is flagged whenever an
+	interval's miss rate moves further than a threshold from the running
+	(exponentially weighted) average, which then restarts from the new rate.
+*/
+struct series {
+    FILE* out;
+    int binary;
+    long every;//0 when only marker crossings end an interval
+    unsigned long marker[2];
+    int useMarkers;
+    double threshold;
+    long accesses;//total so far
+    long start;//access index where the current interval began
+    long lastHits;
+    long lastMiss;
+    long lastEvic;
+    double avgRate;//-1 before the first interval
+    int phases;
+};
+
+struct series* openSeries(char* path, int binary, long every, char* markerPath, double threshold){
+    struct series* ser = (struct series*) calloc(1, sizeof(struct series));
+    if(ser == NULL) return NULL;
+    ser->binary = binary;
+    ser->every = every;
+    ser->threshold = threshold;
+    ser->avgRate = -1;
+    if(markerPath != NULL){
+        FILE* fp = fopen(markerPath, "r");
+        if(fp == NULL || fscanf(fp, "%lx %lx", &ser->marker[0], &ser->marker[1]) != 2){
+            if(fp != NULL) fclose(fp);
+            free(ser);
+            return NULL;
+        }
+        fclose(fp);
+        ser->useMarkers = 1;
+    }
+    ser->out = fopen(path, binary ? "wb" : "w");
+    if(ser->out == NULL){
+        free(ser);
+        return NULL;
+    }
+    if(!binary) fprintf(ser->out, "start,accesses,hits,misses,evictions,miss_rate,phase_change\n");
+    return ser;
+}
+
+//close the current interval and start a new one
+void emitInterval(struct series* ser, struct sim* sim){
+    long n = ser->accesses - ser->start;
+    long hits = sim->hits - ser->lastHits;
+    long miss = sim->miss - ser->lastMiss;
+    long evic = sim->evic - ser->lastEvic;
+    double rate = hits + miss > 0 ? (double) miss / (hits + miss) : 0;
+    int change = 0;
+    if(n == 0) return;
+    if(ser->avgRate < 0){
+        ser->avgRate = rate;
+    } else if(rate - ser->avgRate > ser->threshold || ser->avgRate - rate > ser->threshold){
+        change = 1;
+        ser->phases++;
+        ser->avgRate = rate;
+    } else {
+        ser->avgRate = 0.8 * ser->avgRate + 0.2 * rate;
+    }
+    if(ser->binary){
+        unsigned long long rec[4] = {ser->start, hits, miss, evic};
+        if(change) rec[0] |= 1ULL << 63;//top bit of the start index flags a phase change
+        fwrite(rec, sizeof(rec), 1, ser->out);
+    } else {
+        fprintf(ser->out, "%ld,%ld,%ld,%ld,%ld,%.4f,%d\n", ser->start, n, hits, miss, evic, rate, change);
+    }
+    ser->start = ser->accesses;
+    ser->lastHits = sim->hits;
+    ser->lastMiss = sim->miss;
+    ser->lastEvic = sim->evic;
+}
+
+//account for one simulated access
+void seriesTick(struct series* ser, struct sim* sim, unsigned long addr){
+    ser->accesses++;
+    if((ser->every > 0 && ser->accesses - ser->start >= ser->every) ||
+       (ser->useMarkers && (addr == ser->marker[0] || addr == ser->marker[1]))){
+        emitInterval(ser, sim);
+    }
+}
 
-    printSummary(hits, miss, evic);
+//flush the last partial interval, return the number of phase changes seen
+int closeSeries(struct series* ser, struct sim* sim){
+    int phases;
+    emitInterval(ser, sim);
+    phases = ser->phases;
+    fclose(ser->out);
+    free(ser);
+    return phases;
+}
+
+/*
+	Specialized kernels. When nothing but hits, misses and evictions is being
+	collected, batches for common associativities skip simAccess and run a
+	kernel whose way count is a compile time constant, so the per-set loops
+	unroll completely. Set and tag were already split out by decodeBatch. They
+	implement exactly the same age-counter LRU as isHit/anyInvalid/evict.
+*/
+
+//direct mapped: one compare, one store, no replacement state
+void simBatchDirect(struct sim* sim, const struct batch* batch, int n){
+    struct block* lines = sim->cache[0];//alloCache lays the sets out contiguously
+    int hits = 0, miss = 0, evic = 0;
+    for(int i = 0; i < n; i++){
+        struct block* l = &lines[batch->set[i]];
+        int valid = l->valid == VALID;
+        int hit = valid && l->tag == batch->tag[i];
+        hits += hit + (batch->op[i] == 'M');
+        miss += !hit;
+        evic += valid & !hit;
+        l->tag = batch->tag[i];
+        l->valid = VALID;
+    }
+    sim->hits += hits;
+    sim->miss += miss;
+    sim->evic += evic;
+}
+
+//one set-associative access with a constant way count; inlined into each kernel below
+static inline __attribute__((always_inline))
+void accessWays(struct sim* sim, struct block* set, unsigned long tag, char op, const int ways){
+    int hitIdx = -1, invalIdx = -1, lruIdx = 0, maxLRU = 0;
+    for(int j = 0; j < ways; j++){
+        set[j].LRU++;
+        if(set[j].valid == VALID && set[j].tag == tag) hitIdx = j;
+    }
+    if(op == 'M') sim->hits++;
+    if(hitIdx >= 0){
+        set[hitIdx].LRU = 0;
+        sim->hits++;
+        return;
+    }
+    sim->miss++;
+    for(int j = ways - 1; j >= 0; j--){//the lowest index wins, as in anyInvalid and evict
+        if(set[j].valid == INVALID) invalIdx = j;
+        if(set[j].LRU >= maxLRU){
+            maxLRU = set[j].LRU;
+            lruIdx = j;
+        }
+    }
+    if(invalIdx < 0){
+        sim->evic++;
+        invalIdx = lruIdx;
+    }
+    set[invalIdx].valid = VALID;
+    set[invalIdx].tag = tag;
+    set[invalIdx].LRU = 0;
+}
+
+#define WAYS_KERNEL(W) \
+void simBatch##W##Way(struct sim* sim, const struct batch* batch, int n){ \
+    struct block* lines = sim->cache[0]; \
+    for(int i = 0; i < n; i++){ \
+        if(batch->same[i] & sim->runSkip){ \
+            sim->hits += 1 + (batch->op[i] == 'M'); \
+            continue; \
+        } \
+        accessWays(sim, &lines[batch->set[i] * W], batch->tag[i], batch->op[i], W); \
+    } \
+}
+WAYS_KERNEL(2)
+WAYS_KERNEL(4)
+WAYS_KERNEL(8)//higher E goes to the way index unless --way-index-above is raised
+
+//simulate a decoded batch, picking a specialized kernel when one applies
+void simBatch(struct sim* sim, const struct batch* batch, int n){
+    int plain = sim->sh == NULL && sim->tlb1.sets == NULL && sim->regions == NULL && sim->series == NULL && sim->lat == NULL && sim->buf == NULL;
+    if(plain && sim->ways != NULL){
+        int hits = 0, miss = 0, evic = 0, evicted;
+        unsigned long victim;
+        for(int i = 0; i < n; i++){
+            if(batch->same[i] & sim->runSkip){
+                hits += 1 + (batch->op[i] == 'M');
+                continue;
+            }
+            evicted = 0;
+            int hit = wayAccess(sim->ways, batch->set[i], batch->tag[i], &evicted, &victim);
+            hits += hit + (batch->op[i] == 'M');
+            miss += !hit;
+            evic += evicted;
+        }
+        sim->hits += hits;
+        sim->miss += miss;
+        sim->evic += evic;
+        return;
+    }
+    if(plain){
+        switch(sim->e){
+        case 1: simBatchDirect(sim, batch, n); return;
+        case 2: simBatch2Way(sim, batch, n); return;
+        case 4: simBatch4Way(sim, batch, n); return;
+        case 8: simBatch8Way(sim, batch, n); return;
+        default: break;//generic engine below
+        }
+    }
+    for(int i = 0; i < n; i++){
+        simAccess(sim, batch->op[i], batch->addr[i], batch->set[i], batch->tag[i], batch->same[i]);
+        if(sim->series != NULL) seriesTick(sim->series, sim, batch->addr[i]);
+    }
+}
+
+//seconds on a monotonic clock
+double now(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+	Pipelined mode. A reader thread parses and decodes the trace into batches
+	that travel to the simulating thread through a lock-free single producer,
+	single consumer ring of preallocated slots. A full ring makes the reader
+	wait, and a batch of zero records marks the end of the trace.
+*/
+#define RING_SLOTS 8//power of two
+
+struct ring {
+    struct batch* slots[RING_SLOTS];
+    unsigned long head __attribute__((aligned(64)));//written only by the reader
+    unsigned long tail __attribute__((aligned(64)));//written only by the simulator
+};
+
+struct reader {
+    struct ring* ring;
+    FILE* t;
+    int binary;
+    int s;
+    int b;
+    const struct indexFn* index;
+    double parseTime;
+    double decodeTime;
+};
+
+//producer side: fill the next free slot, waiting while the ring is full
+void* readTrace(void* arg){
+    struct reader* rd = (struct reader*) arg;
+    struct ring* ring = rd->ring;
+    unsigned long head = ring->head;
+    unsigned long prevBlk = ~0UL;
+    int n;
+    do {
+        while(head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == RING_SLOTS) sched_yield();
+        struct batch* batch = ring->slots[head & (RING_SLOTS - 1)];
+        double mark = now();
+        n = rd->binary ? parseBinaryBatch(rd->t, batch, BATCH) : parseBatch(rd->t, batch, BATCH);
+        double parsed = now();
+        decodeBatch(batch, n, rd->s, rd->b, rd->index, &prevBlk);
+        rd->parseTime += parsed - mark;
+        rd->decodeTime += now() - parsed;
+        __atomic_store_n(&ring->head, ++head, __ATOMIC_RELEASE);
+    } while(n > 0);
+    return NULL;
+}
+
+//consumer side: simulate slots as they arrive, return the number of accesses
+long simPipelined(struct sim* sim, struct ring* ring){
+    unsigned long tail = ring->tail;
+    long accesses = 0;
+    for(;;){
+        while(__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail) sched_yield();
+        struct batch* batch = ring->slots[tail & (RING_SLOTS - 1)];
+        int n = batch->n;
+        if(n == 0) break;
+        if(sim->perf != NULL) perfToggle(sim->perf, 1);
+        simBatch(sim, batch, n);
+        if(sim->perf != NULL) perfToggle(sim->perf, 0);
+        accesses += n;
+        __atomic_store_n(&ring->tail, ++tail, __ATOMIC_RELEASE);
+    }
+    return accesses;
+}
+
+//allocate the cache and any TLB levels of sim from the arena, return 0 on success
+//sets the index gives, the caller has checked s + b <= 63
+unsigned long simSets(const struct sim* sim){
+    return sim->index.kind == INDEX_PRIME ? sim->index.sets : 1UL << sim->s;
+}
+
+//return 1 if sets of e lines are more than MAX_LINES
+int tooManyLines(unsigned long sets, int e){
+    return e <= 0 || sets > MAX_LINES || (unsigned long) e > MAX_LINES / sets;
+}
+
+int alloSim(struct sim* sim, struct arena* arena){
+    sim->sets = simSets(sim);
+    if(tooManyLines(sim->sets, sim->e)) return -1;
+    if(sim->e > sim->wayThreshold) sim->ways = alloWayIndex(arena, sim->sets, sim->e);
+    else sim->cache = alloCache(arena, sim->sets, sim->e);
+    if(sim->tlb1.e != 0) sim->tlb1.sets = alloCache(arena, 1UL << sim->tlb1.s, sim->tlb1.e);
+    if(sim->tlb2.e != 0) sim->tlb2.sets = alloCache(arena, 1UL << sim->tlb2.s, sim->tlb2.e);
+    if((sim->cache == NULL && sim->ways == NULL) || (sim->tlb1.e != 0 && sim->tlb1.sets == NULL) || (sim->tlb2.e != 0 && sim->tlb2.sets == NULL)){
+        return -1;
+    }
+    return 0;
+}
+
+//parse, decode and simulate a whole trace on this thread, return the number of accesses
+long simulateStream(struct sim* sim, FILE* t, struct batch* batch, struct phases* ph){
+    int binary = isBinaryTrace(t);
+    unsigned long prevBlk = ~0UL;
+    long accesses = 0;
+    double mark, parsed;
+    int n;
+    for(;;){
+        //parse, decode and simulate in batches so each phase can be timed separately
+        mark = now();
+        n = binary ? parseBinaryBatch(t, batch, BATCH) : parseBatch(t, batch, BATCH);
+        parsed = now();
+        decodeBatch(batch, n, sim->s, sim->b, &sim->index, &prevBlk);
+        ph->parse += parsed - mark;
+        mark = now();
+        ph->decode += mark - parsed;
+        if(n == 0) break;
+        if(sim->perf != NULL) perfToggle(sim->perf, 1);
+        simBatch(sim, batch, n);
+        if(sim->perf != NULL) perfToggle(sim->perf, 0);
+        ph->sim += now() - mark;
+        accesses += n;
+    }
+    return accesses;
+}
+
+/*
+	Batch mode. Many traces are simulated in one process by a pool of worker
+	threads that pull the next trace index from a shared atomic counter. Every
+	trace gets a private copy of the configured sim and its own arena, and the
+	results come back as one table instead of through .csim_results.
+*/
+struct job {
+    char* path;
+    long hits;
+    long miss;
+    long evic;
+    char* status;//"ok", "stored" (answered by the result store) or an error
+};
+
+struct pool {
+    struct job* jobs;
+    int count;
+    int next;//index of the next unclaimed job
+    const struct sim* proto;//configuration shared by every job
+    int huge;
+    const char* config;
+};
+
+void runJob(struct pool* pool, struct job* job, struct batch* batch){
+    struct sim sim = *pool->proto;
+    struct arena arena = {NULL, pool->huge, 0, 0};
+    char key[RESULT_KEY_LEN];
+    struct phases ph = {0, 0, 0, 0, 0};
+    int keyed = resultKey(job->path, pool->config, CSIM_VERSION, key) == 0;
+    if(keyed && loadResult(key, &job->hits, &job->miss, &job->evic)){
+        job->status = "stored";
+        return;
+    }
+    FILE* t = fopen(job->path, "r");
+    if(t == NULL){
+        job->status = "unreadable";
+        return;
+    }
+    if(alloSim(&sim, &arena) != 0){
+        job->status = "no-memory";
+    } else {
+        simulateStream(&sim, t, batch, &ph);
+        job->hits = sim.hits;
+        job->miss = sim.miss;
+        job->evic = sim.evic;
+        job->status = "ok";
+        if(keyed) saveResult(key, sim.hits, sim.miss, sim.evic);
+    }
+    fclose(t);
+    freeArena(&arena);
+}
+
+void* batchWorker(void* arg){
+    struct pool* pool = (struct pool*) arg;
+    struct batch* batch = (struct batch*) malloc(sizeof(struct batch));
+    int i;
+    if(batch == NULL) return NULL;//the other workers pick up the slack
+    while((i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) < pool->count){
+        runJob(pool, &pool->jobs[i], batch);
+    }
+    free(batch);
+    return NULL;
+}
+
+//simulate every trace across jobs threads and print one row per trace
+void runBatch(const struct sim* proto, char** paths, int count, int jobs, int huge, const char* config){
+    struct pool pool = {NULL, count, 0, proto, huge, config};
+    pthread_t* threads = (pthread_t*) malloc(jobs * sizeof(pthread_t));
+    int started = 0;
+    pool.jobs = (struct job*) calloc(count, sizeof(struct job));
+    if(pool.jobs == NULL || threads == NULL){
+        printf("could not allocate %d batch jobs\n", count);
+        free(pool.jobs);
+        free(threads);
+        return;
+    }
+    for(int i = 0; i < count; i++){
+        pool.jobs[i].path = paths[i];
+        pool.jobs[i].status = "not-run";
+    }
+    for(int i = 0; i < jobs && i < count; i++){
+        if(pthread_create(&threads[started], NULL, batchWorker, &pool) == 0) started++;
+    }
+    if(started == 0) batchWorker(&pool);//no threads, run everything here
+    for(int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    printf("%-40s %10s %10s %10s  %s\n", "trace", "hits", "misses", "evictions", "status");
+    for(int i = 0; i < count; i++){
+        struct job* j = &pool.jobs[i];
+        printf("%-40s %10ld %10ld %10ld  %s\n", j->path, j->hits, j->miss, j->evic, j->status);
+    }
+    free(pool.jobs);
+    free(threads);
+}
+
+//read one path per line from a list file, return the number read
+int readTraceList(char* listName, char*** paths){
+    FILE* fp = fopen(listName, "r");
+    char line[4096];
+    int count = 0, cap = 64;
+    if(fp == NULL) return 0;
+    *paths = (char**) malloc(cap * sizeof(char*));
+    while(*paths != NULL && fgets(line, sizeof(line), fp) != NULL){
+        line[strcspn(line, "\r\n")] = '\0';
+        if(line[0] == '\0' || line[0] == '#') continue;
+        if(count == cap){
+            char** grown = (char**) realloc(*paths, 2 * cap * sizeof(char*));
+            if(grown == NULL) break;
+            *paths = grown;
+            cap *= 2;
+        }
+        (*paths)[count] = strdup(line);
+        if((*paths)[count] != NULL) count++;
+    }
+    fclose(fp);
+    return count;
+}
+
+/*
+	Shared cache mode. Several traces are replayed round robin, quantum records
+	at a time, into one cache whose lines remember which tenant filled them, so
+	tenants never hit on each other's blocks. Replacement is LRU by last-use
+	stamp within the ways a tenant may fill: its CAT-style way mask, or under
+	utility-based partitioning (UCP) the lines that the current allocation lets
+	it take. UCP keeps a full per-tenant shadow LRU stack (UMON) per set, counts
+	hits by stack depth, and every interval hands out the ways with the
+	lookahead algorithm, then halves the counts. An eviction of another tenant's
+	line is counted as interference against the evictor.
+*/
+#define MAX_TENANTS 8
+
+struct tenant {
+    char* path;
+    FILE* t;
+    int binary;
+    unsigned long mask;//ways this tenant may fill
+    struct batch* batch;
+    int pos;//next record of batch
+    int done;
+    long hits;
+    long misses;
+    long evictions;
+    long interference[MAX_TENANTS];//lines this tenant evicted from each other tenant
+    unsigned long* umon;//[set * e + depth] shadow LRU stack, EMPTY when unused
+    long* depthHits;//[depth]
+    int alloc;//ways granted by the last repartition
+};
+
+struct shared {
+    int s;
+    int e;
+    int b;
+    unsigned long sets;
+    struct indexFn index;
+    unsigned long* blocks;//[set * e + way]
+    unsigned long* stamps;//[set * e + way] last use, 0 when invalid
+    unsigned char* owners;//[set * e + way]
+    unsigned long clock;
+    int count;
+    struct tenant tenants[MAX_TENANTS];
+    long quantum;
+    long ucpInterval;//0 unless partitioning by utility
+    long sinceRepartition;
+    int repartitions;
+};
+
+//parse <trace>[:<hex way mask>] into the next tenant, return 0 on success
+int addTenant(struct shared* sh, char* arg){
+    struct tenant* tn;
+    char* colon = strrchr(arg, ':');
+    char* end = NULL;
+    unsigned long mask = 0;
+    if(sh->count == MAX_TENANTS) return -1;
+    if(colon != NULL){
+        mask = strtoul(colon + 1, &end, 16);
+        if(end == colon + 1 || *end != '\0') colon = NULL;//part of the path after all
+        else *colon = '\0';
+    }
+    tn = &sh->tenants[sh->count];
+    memset(tn, 0, sizeof(*tn));
+    tn->path = arg;
+    tn->mask = colon != NULL ? mask : ~0UL;
+    sh->count++;
+    return 0;
+}
+
+int alloShared(struct shared* sh, struct arena* a){
+    unsigned long lines;
+    unsigned long all = sh->e >= 64 ? ~0UL : (1UL << sh->e) - 1;
+    sh->sets = sh->index.kind == INDEX_PRIME ? sh->index.sets : 1UL << sh->s;
+    lines = sh->sets * sh->e;//main has checked it against MAX_LINES
+    sh->blocks = (unsigned long*) arenaAlloc(a, arraySize(lines, sizeof(unsigned long)));
+    sh->stamps = (unsigned long*) arenaAlloc(a, arraySize(lines, sizeof(unsigned long)));
+    sh->owners = (unsigned char*) arenaAlloc(a, lines);
+    if(sh->blocks == NULL || sh->stamps == NULL || sh->owners == NULL) return -1;
+    for(int i = 0; i < sh->count; i++){
+        struct tenant* tn = &sh->tenants[i];
+        tn->mask &= all;
+        tn->alloc = sh->e / sh->count;
+        if(tn->mask == 0) return -1;
+        tn->batch = (struct batch*) malloc(sizeof(struct batch));
+        if(tn->batch == NULL) return -1;
+        tn->batch->n = 0;
+        if(sh->ucpInterval > 0){
+            tn->umon = (unsigned long*) arenaAlloc(a, lines * sizeof(unsigned long));
+            tn->depthHits = (long*) arenaAlloc(a, sh->e * sizeof(long));
+            if(tn->umon == NULL || tn->depthHits == NULL) return -1;
+            memset(tn->umon, 0xff, lines * sizeof(unsigned long));
+        }
+    }
+    return 0;
+}
+
+//look blk up in the tenant's shadow stack, counting a hit by depth and moving it to the top
+void umonAccess(struct shared* sh, struct tenant* tn, unsigned long set, unsigned long blk){
+    unsigned long* stack = &tn->umon[set * sh->e];
+    int depth;
+    for(depth = 0; depth < sh->e - 1 && stack[depth] != blk; depth++);
+    if(stack[depth] == blk) tn->depthHits[depth]++;
+    memmove(&stack[1], &stack[0], depth * sizeof(unsigned long));
+    stack[0] = blk;
+}
+
+/*
+	Lookahead allocation: every tenant starts with one way, then the tenant
+	whose best next run of k ways gains the most hits per way takes those k
+	ways, until none are left.
+*/
+void repartition(struct shared* sh){
+    int balance = sh->e - sh->count;
+    for(int i = 0; i < sh->count; i++) sh->tenants[i].alloc = 1;
+    while(balance > 0){
+        int winner = 0, winnerWays = 1;
+        double best = -1;
+        for(int i = 0; i < sh->count; i++){
+            struct tenant* tn = &sh->tenants[i];
+            long gain = 0;
+            for(int k = 1; k <= balance; k++){
+                gain += tn->depthHits[tn->alloc + k - 1];
+                if((double) gain / k > best){
+                    best = (double) gain / k;
+                    winner = i;
+                    winnerWays = k;
+                }
+            }
+        }
+        sh->tenants[winner].alloc += winnerWays;
+        balance -= winnerWays;
+    }
+    for(int i = 0; i < sh->count; i++){
+        for(int d = 0; d < sh->e; d++) sh->tenants[i].depthHits[d] /= 2;
+    }
+    sh->repartitions++;
+}
+
+//choose the way tenant t fills in the set starting at base
+int sharedVictim(struct shared* sh, int t, unsigned long base){
+    int owned[MAX_TENANTS] = {0};
+    int victim = -1;
+    unsigned long mask = sh->ucpInterval > 0 ? ~0UL : sh->tenants[t].mask;
+    for(int w = 0; w < sh->e; w++){
+        if(!(mask >> w & 1)) continue;
+        if(sh->stamps[base + w] == 0) return w;//an invalid way first, lowest index like anyInvalid
+        owned[sh->owners[base + w]]++;
+    }
+    if(sh->ucpInterval > 0){
+        //under its allocation: take from a tenant over theirs, else from anyone else
+        int under = owned[t] < sh->tenants[t].alloc;
+        for(int pass = 0; pass < 2 && victim < 0; pass++){
+            for(int w = 0; w < sh->e; w++){
+                int o = sh->owners[base + w];
+                int ok = under ? o != t && (pass == 1 || owned[o] > sh->tenants[o].alloc) : o == t;
+                if(ok && (victim < 0 || sh->stamps[base + w] < sh->stamps[base + victim])) victim = w;
+            }
+        }
+        if(victim >= 0) return victim;
+    }
+    for(int w = 0; w < sh->e; w++){
+        if((mask >> w & 1) && (victim < 0 || sh->stamps[base + w] < sh->stamps[base + victim])) victim = w;
+    }
+    return victim;
+}
+
+void sharedAccess(struct shared* sh, int t, char op, unsigned long addr){
+    struct tenant* tn = &sh->tenants[t];
+    unsigned long blk = addr >> sh->b;
+    unsigned long set = sh->index.kind == INDEX_MODULO ? blk & (sh->sets - 1) : hashedSet(&sh->index, blk);
+    unsigned long base = set * sh->e;
+    if(op == 'M') tn->hits++;//the store half always hits
+    if(sh->ucpInterval > 0){
+        umonAccess(sh, tn, set, blk);
+        if(++sh->sinceRepartition == sh->ucpInterval){
+            repartition(sh);
+            sh->sinceRepartition = 0;
+        }
+    }
+    for(int w = 0; w < sh->e; w++){
+        if(sh->stamps[base + w] != 0 && sh->owners[base + w] == t && sh->blocks[base + w] == blk){
+            sh->stamps[base + w] = ++sh->clock;
+            tn->hits++;
+            return;
+        }
+    }
+    tn->misses++;
+    int w = sharedVictim(sh, t, base);
+    if(sh->stamps[base + w] != 0){
+        tn->evictions++;
+        if(sh->owners[base + w] != t) tn->interference[sh->owners[base + w]]++;
+    }
+    sh->blocks[base + w] = blk;
+    sh->owners[base + w] = (unsigned char) t;
+    sh->stamps[base + w] = ++sh->clock;
+}
+
+//replay every tenant's trace interleaved, return -1 if a trace can't be opened
+int runShared(struct shared* sh){
+    int live = 0;
+    for(int i = 0; i < sh->count; i++){
+        struct tenant* tn = &sh->tenants[i];
+        tn->t = fopen(tn->path, "r");
+        if(tn->t == NULL){
+            printf("could not open %s\n", tn->path);
+            return -1;
+        }
+        tn->binary = isBinaryTrace(tn->t);
+        live++;
+    }
+    while(live > 0){
+        for(int i = 0; i < sh->count; i++){
+            struct tenant* tn = &sh->tenants[i];
+            for(long q = 0; q < sh->quantum && !tn->done; q++){
+                if(tn->pos == tn->batch->n){
+                    tn->batch->n = tn->binary ? parseBinaryBatch(tn->t, tn->batch, BATCH) : parseBatch(tn->t, tn->batch, BATCH);
+                    tn->pos = 0;
+                    if(tn->batch->n == 0){
+                        tn->done = 1;
+                        live--;
+                        break;
+                    }
+                }
+                sharedAccess(sh, i, tn->batch->op[tn->pos], tn->batch->addr[tn->pos]);
+                tn->pos++;
+            }
+        }
+    }
+    for(int i = 0; i < sh->count; i++){
+        fclose(sh->tenants[i].t);
+        free(sh->tenants[i].batch);
+    }
+    return 0;
+}
+
+void printShared(struct shared* sh){
+    long hits = 0, misses = 0, evictions = 0;
+    for(int i = 0; i < sh->count; i++){
+        struct tenant* tn = &sh->tenants[i];
+        long caused = 0, suffered = 0;
+        for(int j = 0; j < sh->count; j++){
+            caused += tn->interference[j];
+            suffered += sh->tenants[j].interference[i];
+        }
+        printf("tenant %d %s", i, tn->path);
+        if(sh->ucpInterval > 0) printf(" ways:%d", sh->tenants[i].alloc);
+        else printf(" mask:%lx", tn->mask);
+        printf(" hits:%ld misses:%ld evictions:%ld interference-caused:%ld interference-suffered:%ld\n",
+               tn->hits, tn->misses, tn->evictions, caused, suffered);
+        hits += tn->hits;
+        misses += tn->misses;
+        evictions += tn->evictions;
+    }
+    for(int i = 0; i < sh->count; i++){
+        for(int j = 0; j < sh->count; j++){
+            if(sh->tenants[i].interference[j] > 0)
+                printf("tenant %d evicts tenant %d: %ld\n", i, j, sh->tenants[i].interference[j]);
+        }
+    }
+    if(sh->ucpInterval > 0) printf("ucp repartitions:%d\n", sh->repartitions);
+    printSummaryLong(hits, misses, evictions);
+}
+
+/*
+	Miss-stream diff. Two traces of the same computation, say two transpose
+	variants, are simulated one after the other with identical geometry, and
+	every miss is charged to the matrix element it touched, found through the
+	regions file (which gives each matrix its address range and shape). Lining
+	the two runs up by element rather than by position in the stream shows
+	where one variant misses and the other doesn't: by tile, by set, and by the
+	line whose fill last evicted the element's block. Each trace uses its own
+	<trace>.regions when there is one, since the matrices can move between runs.
+*/
+struct diffSide {
+    char* path;
+    struct regions* regions;
+    long base[MAX_REGIONS + 1];//first element of each region in misses
+    long blockBase[MAX_REGIONS + 1];//first block of each region in evictor
+    int* misses;//[element]
+    unsigned long* evictor;//[block] address of the access that last evicted it, 0 if none
+    unsigned long* cause;//[element] evictor of its block when it last missed, 0 if compulsory
+    long* setMisses;//[set]
+    unsigned long sets;
+    long hits;
+    long missTotal;
+    long regionMisses[MAX_REGIONS + 1];//count is everything outside the matrices
+};
+
+struct diffRow {
+    long key;//element, tile or set
+    long x;
+    long y;
+};
+
+int elemSize(const struct regions* r, int i){
+    long cells = (long) r->rows[i] * r->cols[i];
+    long size = cells ? (long)(r->end[i] - r->start[i]) / cells : 0;
+    return size > 0 ? (int) size : 4;
+}
+
+//element index (across every shaped region) of addr, -1 if it is in none
+long elemOf(const struct diffSide* d, unsigned long addr, int* region){
+    const struct regions* r = d->regions;
+    int i = regionOf(d->regions, addr);
+    *region = i;
+    if(i == r->count || r->rows[i] == 0) return -1;
+    return d->base[i] + (long)((addr - r->start[i]) / elemSize(r, i));
+}
+
+//index into evictor of the block holding addr, -1 if it is outside the matrices
+long blockOf(const struct diffSide* d, unsigned long addr, int b){
+    const struct regions* r = d->regions;
+    int i = regionOf(d->regions, addr);
+    if(i == r->count || r->rows[i] == 0) return -1;
+    return d->blockBase[i] + (long)((addr >> b) - (r->start[i] >> b));
+}
+
+//release what a failed diffRun allocated for one side
+void freeDiffRun(struct diffSide* d, struct arena* arena, FILE* t){
+    free(d->misses);
+    free(d->evictor);
+    free(d->cause);
+    free(d->setMisses);
+    d->misses = NULL;
+    d->evictor = NULL;
+    d->cause = NULL;
+    d->setMisses = NULL;
+    freeArena(arena);
+    fclose(t);
+}
+
+//simulate one side, charging every miss to its element and set
+int diffRun(struct diffSide* d, const struct sim* proto, int b, struct batch* batch){
+    struct sim sim = *proto;
+    struct arena arena = {NULL, 0, 0, 0};
+    const struct regions* r = d->regions;
+    long elems = 0, blocks = 0;
+    unsigned long prevBlk = ~0UL;
+    FILE* t = fopen(d->path, "r");
+    if(t == NULL) return -1;
+    for(int i = 0; i < r->count; i++){
+        d->base[i] = elems;
+        d->blockBase[i] = blocks;
+        if(r->rows[i] == 0) continue;
+        elems += (long) r->rows[i] * r->cols[i];
+        blocks += (long)(((r->end[i] - 1) >> b) - (r->start[i] >> b) + 1);
+    }
+    if(alloSim(&sim, &arena) != 0){
+        freeDiffRun(d, &arena, t);
+        return -1;
+    }
+    d->misses = (int*) calloc(elems + 1, sizeof(int));
+    d->evictor = (unsigned long*) calloc(blocks + 1, sizeof(unsigned long));
+    d->cause = (unsigned long*) calloc(elems + 1, sizeof(unsigned long));
+    d->sets = sim.sets;
+    d->setMisses = (long*) calloc(sim.sets, sizeof(long));
+    if(d->misses == NULL || d->evictor == NULL || d->cause == NULL || d->setMisses == NULL){
+        freeDiffRun(d, &arena, t);
+        return -1;
+    }
+    int binary = isBinaryTrace(t);
+    int n;
+    while((n = binary ? parseBinaryBatch(t, batch, BATCH) : parseBatch(t, batch, BATCH)) > 0){
+        decodeBatch(batch, n, sim.s, sim.b, &sim.index, &prevBlk);
+        for(int i = 0; i < n; i++){
+            unsigned long victim = 0, set = batch->set[i];
+            int evicted = 0, region;
+            int hit = sim.ways != NULL ? wayAccess(sim.ways, set, batch->tag[i], &evicted, &victim)
+                                       : cacheAccess(&sim, set, batch->tag[i], &evicted, &victim);
+            d->hits += hit + (batch->op[i] == 'M');
+            if(hit) continue;
+            long e = elemOf(d, batch->addr[i], &region);
+            d->missTotal++;
+            d->regionMisses[region]++;
+            d->setMisses[set]++;
+            if(e >= 0){
+                d->misses[e]++;
+                d->cause[e] = d->evictor[blockOf(d, batch->addr[i], b)];
+            }
+            if(evicted){
+                unsigned long victimBlk = sim.index.kind == INDEX_MODULO ? (victim << sim.s) | set : victim;
+                long vb = blockOf(d, victimBlk << b, b);
+                if(vb >= 0) d->evictor[vb] = batch->addr[i];
+            }
+        }
+    }
+    fclose(t);
+    freeArena(&arena);
+    return 0;
+}
+
+//name of an element as Region[row][col]
+void elemName(const struct diffSide* d, long e, char* out, size_t size){
+    const struct regions* r = d->regions;
+    for(int i = r->count - 1; i >= 0; i--){
+        if(r->rows[i] == 0 || e < d->base[i]) continue;
+        long k = e - d->base[i];
+        snprintf(out, size, "%s[%ld][%ld]", r->names[i], k / r->cols[i], k % r->cols[i]);
+        return;
+    }
+    snprintf(out, size, "?");
+}
+
+//name of the matrix element at addr, or the region (or "other") when it has no shape
+void addrName(const struct diffSide* d, unsigned long addr, char* out, size_t size){
+    int region;
+    long e = elemOf(d, addr, &region);
+    if(e >= 0) elemName(d, e, out, size);
+    else snprintf(out, size, "%s:%lx", d->regions->names[region], addr);
+}
+
+int byDelta(const void* a, const void* b){
+    const struct diffRow* p = (const struct diffRow*) a;
+    const struct diffRow* q = (const struct diffRow*) b;
+    long dp = labs(p->y - p->x), dq = labs(q->y - q->x);
+    if(dp != dq) return dp < dq ? 1 : -1;
+    return p->key < q->key ? -1 : p->key > q->key;
+}
+
+//load the side's regions from <trace>.regions, falling back to the shared file
+int diffOpen(struct diffSide* d, char* path, char* fallback, unsigned long sets){
+    char name[512];
+    FILE* fp;
+    d->path = path;
+    snprintf(name, sizeof(name), "%s.regions", path);
+    if((fp = fopen(name, "r")) != NULL) fclose(fp);
+    else if(fallback != NULL) snprintf(name, sizeof(name), "%s", fallback);
+    d->regions = loadRegions(name, sets);
+    return d->regions == NULL ? -1 : 0;
+}
+
+void printDiff(struct diffSide* x, struct diffSide* y, int tile, int top){
+    unsigned long sets = x->sets;
+    const struct regions* r = x->regions;
+    char name[96], by[96];
+    printf("diff %s vs %s: misses %ld vs %ld", x->path, y->path, x->missTotal, y->missTotal);
+    for(int i = 0; i <= r->count; i++){
+        printf("%s %s %ld vs %ld", i ? "," : " (", r->names[i], x->regionMisses[i], y->regionMisses[i]);
+    }
+    printf(")\n");
+
+    //tiles: tile x tile blocks of each shaped region
+    long tiles = 0;
+    for(int i = 0; i < r->count; i++){
+        if(r->rows[i]) tiles += (long)((r->rows[i] + tile - 1) / tile) * ((r->cols[i] + tile - 1) / tile);
+    }
+    struct diffRow* rows = (struct diffRow*) calloc((tiles > (long) sets ? tiles : (long) sets) + 1, sizeof(struct diffRow));
+    if(rows == NULL) return;
+    long t = 0;
+    for(int i = 0; i < r->count; i++){
+        if(r->rows[i] == 0) continue;
+        long across = (r->cols[i] + tile - 1) / tile;
+        long first = t;
+        t += across * ((r->rows[i] + tile - 1) / tile);
+        for(long k = 0; k < (long) r->rows[i] * r->cols[i]; k++){
+            struct diffRow* row = &rows[first + (k / r->cols[i] / tile) * across + (k % r->cols[i]) / tile];
+            row->key = first + (k / r->cols[i] / tile) * across + (k % r->cols[i]) / tile;
+            row->x += x->misses[x->base[i] + k];
+            row->y += y->misses[y->base[i] + k];
+        }
+    }
+    qsort(rows, tiles, sizeof(struct diffRow), byDelta);
+    printf("tiles (%dx%d) whose misses differ most:\n", tile, tile);
+    for(long k = 0; k < tiles && k < top && rows[k].x != rows[k].y; k++){
+        //walk back from the tile number to its region and corner
+        long key = rows[k].key, first = 0;
+        for(int i = 0; i < r->count; i++){
+            if(r->rows[i] == 0) continue;
+            long across = (r->cols[i] + tile - 1) / tile;
+            long count = across * ((r->rows[i] + tile - 1) / tile);
+            if(key < first + count){
+                long row0 = (key - first) / across * tile, col0 = (key - first) % across * tile;
+                printf("  %s[%ld..%ld][%ld..%ld] %ld vs %ld (%+ld)\n", r->names[i],
+                       row0, row0 + tile - 1 < r->rows[i] ? row0 + tile - 1 : r->rows[i] - 1,
+                       col0, col0 + tile - 1 < r->cols[i] ? col0 + tile - 1 : r->cols[i] - 1,
+                       rows[k].x, rows[k].y, rows[k].y - rows[k].x);
+                break;
+            }
+            first += count;
+        }
+    }
+
+    for(unsigned long s = 0; s < sets; s++){
+        rows[s].key = s;
+        rows[s].x = x->setMisses[s];
+        rows[s].y = y->setMisses[s];
+    }
+    qsort(rows, sets, sizeof(struct diffRow), byDelta);
+    printf("sets whose misses differ most:\n");
+    for(long k = 0; k < (long) sets && k < top && rows[k].x != rows[k].y; k++){
+        printf("  set %ld %ld vs %ld (%+ld)\n", rows[k].key, rows[k].x, rows[k].y, rows[k].y - rows[k].x);
+    }
+    free(rows);
+
+    //elements that miss in one run only, with whatever evicted them there
+    long elems = 0;
+    for(int i = 0; i < r->count; i++){
+        if(r->rows[i]) elems = x->base[i] + (long) r->rows[i] * r->cols[i];
+    }
+    for(int pass = 0; pass < 2; pass++){
+        struct diffSide* miss = pass ? y : x;
+        struct diffSide* hit = pass ? x : y;
+        long shown = 0, total = 0;
+        for(long e = 0; e < elems; e++){
+            if(miss->misses[e] == 0 || hit->misses[e] != 0) continue;
+            total++;
+            if(shown == top) continue;
+            shown++;
+            elemName(miss, e, name, sizeof(name));
+            if(miss->cause[e]) addrName(miss, miss->cause[e], by, sizeof(by));
+            else snprintf(by, sizeof(by), "nothing (compulsory)");
+            printf("  %s missed %dx only in %s, last evicted by %s\n", name, miss->misses[e], miss->path, by);
+        }
+        printf("elements missing only in %s: %ld\n", miss->path, total);
+    }
+}
+
+/*
+	Representative intervals. simpoint reduces a long trace to a few intervals,
+	each written after a warm-up prefix of the accesses that preceded it, and
+	lists them in a .points file with the share of the trace each stands for.
+	--points replays every interval on a cold cache, drops what the warm-up
+	counted and adds the rest scaled by its weight, giving estimated totals
+	for the whole trace.
+*/
+struct point {
+    long warm;
+    long length;
+    double weight;//accesses of the full trace each replayed access stands for
+};
+
+//read the "<start> <warm> <length> <weight>" lines of a .points file, return how many or -1
+int loadPoints(char* path, struct point** points, long* accesses){
+    char line[256];
+    int count = 0, cap = 0;
+    long start;
+    FILE* fp = fopen(path, "r");
+    if(fp == NULL) return -1;
+    *points = NULL;
+    *accesses = 0;
+    while(fgets(line, sizeof(line), fp) != NULL){
+        struct point p;
+        if(line[0] == '#'){
+            sscanf(line, "# accesses:%ld", accesses);
+            continue;
+        }
+        if(sscanf(line, "%ld %ld %ld %lf", &start, &p.warm, &p.length, &p.weight) != 4) continue;
+        if(count == cap){
+            cap = cap ? 2 * cap : 16;
+            struct point* grown = (struct point*) realloc(*points, cap * sizeof(struct point));
+            if(grown == NULL) break;
+            *points = grown;
+        }
+        (*points)[count++] = p;
+    }
+    fclose(fp);
+    return count;
+}
+
+//replay the points of a reduced trace, return 0 and the scaled counts, or -1 if the trace runs short
+int runPoints(const struct sim* proto, FILE* t, const struct point* points, int count, struct batch* batch,
+              struct arena* arena, double est[3]){
+    int binary = isBinaryTrace(t);
+    est[0] = est[1] = est[2] = 0;
+    for(int i = 0; i < count; i++){
+        struct sim sim = *proto;
+        unsigned long prevBlk = ~0UL;
+        resetArena(arena);
+        if(alloSim(&sim, arena) != 0) return -1;
+        for(int measured = 0; measured < 2; measured++){
+            long left = measured ? points[i].length : points[i].warm;
+            //only the interval itself is counted
+            sim.hits = sim.miss = sim.evic = 0;
+            while(left > 0){
+                int want = left < BATCH ? (int) left : BATCH;
+                int n = binary ? parseBinaryBatch(t, batch, want) : parseBatch(t, batch, want);
+                if(n == 0) return -1;
+                decodeBatch(batch, n, sim.s, sim.b, &sim.index, &prevBlk);
+                simBatch(&sim, batch, n);
+                left -= n;
+            }
+        }
+        est[0] += points[i].weight * sim.hits;
+        est[1] += points[i].weight * sim.miss;
+        est[2] += points[i].weight * sim.evic;
+    }
+    return 0;
+}
+
+/*
+	Service mode. csim listens on a Unix domain socket and answers one request
+	per line, so tuning loops don't pay process startup and .csim_results
+	handoff per simulation:
+	    s=<s> E=<E> b=<b> [index=<spec>] trace=<path>
+	    s=<s> E=<E> b=<b> [index=<spec>] inline=<n>   followed by n trace lines
+	    shutdown
+	Each answer is one line, "ok hits:<h> misses:<m> evictions:<e> source:<how>"
+	or "error <reason>". Every client gets its own thread, and that thread keeps
+	one arena whose pages stay mapped between requests. Parsed traces are kept
+	in memory, keyed by path and checked against the file's size and mtime,
+	and each one remembers its results per configuration.
+*/
+#define SERVE_LINE 1024
+#define MAX_INLINE (1 << 24)//records in one inline request
+
+struct memo {
+    struct memo* next;
+    char config[256];
+    long hits;
+    long miss;
+    long evic;
+};
+
+struct parsedTrace {
+    struct parsedTrace* next;
+    char* path;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    long n;
+    char* op;
+    unsigned long* addr;
+    int refs;
+    int stale;//dropped from the cache, freed by the last release
+    struct memo* memos;
+};
+
+struct traceCache {
+    pthread_mutex_t lock;
+    struct parsedTrace* head;//most recently used first
+    size_t bytes;
+    size_t budget;
+    int listenFd;
+};
+
+static struct traceCache traces = {PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0, -1};
+
+void freeParsed(struct parsedTrace* p){
+    while(p->memos != NULL){
+        struct memo* next = p->memos->next;
+        free(p->memos);
+        p->memos = next;
+    }
+    free(p->path);
+    free(p->op);
+    free(p->addr);
+    free(p);
+}
+
+size_t parsedBytes(const struct parsedTrace* p){
+    return p->n * (sizeof(char) + sizeof(unsigned long));
+}
+
+//unlink an entry, the caller holds the lock
+void dropParsed(struct parsedTrace* p){
+    struct parsedTrace** link = &traces.head;
+    while(*link != p) link = &(*link)->next;
+    *link = p->next;
+    traces.bytes -= parsedBytes(p);
+    if(p->refs == 0) freeParsed(p);
+    else p->stale = 1;
+}
+
+//read a whole trace into memory, NULL if it can't be read
+struct parsedTrace* parseWhole(const char* path, const struct stat* st, struct batch* batch){
+    FILE* t = fopen(path, "r");
+    if(t == NULL) return NULL;
+    struct parsedTrace* p = (struct parsedTrace*) calloc(1, sizeof(struct parsedTrace));
+    long cap = 0;
+    int binary = isBinaryTrace(t);
+    int n;
+    if(p == NULL || (p->path = strdup(path)) == NULL){
+        free(p);
+        fclose(t);
+        return NULL;
+    }
+    while((n = binary ? parseBinaryBatch(t, batch, BATCH) : parseBatch(t, batch, BATCH)) > 0){
+        if(p->n + n > cap){
+            cap = cap ? cap * 2 : BATCH;
+            char* op = (char*) realloc(p->op, cap);
+            if(op != NULL) p->op = op;
+            unsigned long* addr = (unsigned long*) realloc(p->addr, cap * sizeof(unsigned long));
+            if(addr != NULL) p->addr = addr;
+            if(op == NULL || addr == NULL){
+                freeParsed(p);
+                fclose(t);
+                return NULL;
+            }
+        }
+        memcpy(p->op + p->n, batch->op, n);
+        memcpy(p->addr + p->n, batch->addr, n * sizeof(unsigned long));
+        p->n += n;
+    }
+    fclose(t);
+    p->dev = st->st_dev;
+    p->ino = st->st_ino;
+    p->size = st->st_size;
+    p->mtime = st->st_mtim;
+    return p;
+}
+
+int sameFile(const struct parsedTrace* p, const struct stat* st){
+    return p->dev == st->st_dev && p->ino == st->st_ino && p->size == st->st_size &&
+        p->mtime.tv_sec == st->st_mtim.tv_sec && p->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+//find or parse a trace and take a reference to it, *parsed says which
+struct parsedTrace* acquireParsed(const char* path, struct batch* batch, int* parsed){
+    struct stat st;
+    struct parsedTrace* p;
+    if(stat(path, &st) != 0) return NULL;
+    *parsed = 0;
+    pthread_mutex_lock(&traces.lock);
+    for(p = traces.head; p != NULL; p = p->next){
+        if(strcmp(p->path, path) != 0) continue;
+        if(sameFile(p, &st)){
+            p->refs++;
+            dropParsed(p);//moved to the front below
+            p->stale = 0;
+            break;
+        }
+        dropParsed(p);//the file changed underneath us
+        p = NULL;
+        break;
+    }
+    pthread_mutex_unlock(&traces.lock);
+    if(p == NULL){
+        //parse outside the lock; two clients may race on one trace and both parse it
+        p = parseWhole(path, &st, batch);
+        if(p == NULL) return NULL;
+        p->refs = 1;
+        *parsed = 1;
+    }
+    pthread_mutex_lock(&traces.lock);
+    if(*parsed){
+        //if another client got there first, keep its copy so the trace is held and counted once
+        struct parsedTrace* q;
+        for(q = traces.head; q != NULL && strcmp(q->path, path) != 0; q = q->next);
+        if(q != NULL && sameFile(q, &st)){
+            q->refs++;
+            dropParsed(q);//moved to the front below
+            q->stale = 0;
+            freeParsed(p);
+            p = q;
+        } else if(q != NULL){
+            dropParsed(q);
+        }
+    }
+    p->next = traces.head;
+    traces.head = p;
+    traces.bytes += parsedBytes(p);
+    //stay within the budget by dropping the least recently used traces
+    while(traces.bytes > traces.budget){
+        struct parsedTrace* last = traces.head;
+        while(last->next != NULL) last = last->next;
+        if(last == p) break;//only the trace in use is left
+        dropParsed(last);
+    }
+    pthread_mutex_unlock(&traces.lock);
+    return p;
+}
+
+void releaseParsed(struct parsedTrace* p){
+    pthread_mutex_lock(&traces.lock);
+    if(--p->refs == 0 && p->stale) freeParsed(p);
+    pthread_mutex_unlock(&traces.lock);
+}
+
+//decode and simulate records already in memory
+void simulateRecords(struct sim* sim, struct batch* batch, const char* op, const unsigned long* addr, long n){
+    unsigned long prevBlk = ~0UL;
+    for(long i = 0; i < n; i += BATCH){
+        int m = n - i < BATCH ? (int)(n - i) : BATCH;
+        memcpy(batch->op, op + i, m);
+        memcpy(batch->addr, addr + i, m * sizeof(unsigned long));
+        decodeBatch(batch, m, sim->s, sim->b, &sim->index, &prevBlk);
+        simBatch(sim, batch, m);
+    }
+}
+
+//fill sim from one request line, return NULL or the reason it is refused
+const char* parseRequest(char* line, struct sim* sim, char* config, char** trace, long* inlineCount){
+    char* save = NULL;
+    char* indexName = NULL;
+    memset(sim, 0, sizeof(*sim));
+    sim->walkCost = 30;
+    sim->wayThreshold = DEFAULT_WAY_INDEX_THRESHOLD;
+    sim->runSkip = 1;
+    sim->s = sim->e = sim->b = -1;
+    *trace = NULL;
+    *inlineCount = -1;
+    for(char* tok = strtok_r(line, " \t\r\n", &save); tok != NULL; tok = strtok_r(NULL, " \t\r\n", &save)){
+        if(strncmp(tok, "s=", 2) == 0) sim->s = atoi(tok + 2);
+        else if(strncmp(tok, "E=", 2) == 0) sim->e = atoi(tok + 2);
+        else if(strncmp(tok, "b=", 2) == 0) sim->b = atoi(tok + 2);
+        else if(strncmp(tok, "trace=", 6) == 0) *trace = tok + 6;
+        else if(strncmp(tok, "inline=", 7) == 0) *inlineCount = atol(tok + 7);
+        else if(strncmp(tok, "index=", 6) == 0){
+            indexName = tok + 6;
+            if(parseIndex(indexName, &sim->index) != 0) return "bad index";
+        }
+        else return "unknown field";
+    }
+    if(sim->s < 0 || sim->e <= 0 || sim->b < 0 || sim->s + sim->b > 63) return "need s, E and b";
+    if(tooManyLines(simSets(sim), sim->e)) return "cache too large";
+    if((*trace == NULL) == (*inlineCount < 0)) return "need one of trace= or inline=";
+    if(*inlineCount > MAX_INLINE) return "inline batch too large";
+    if(sim->index.kind == INDEX_MATRIX && sim->index.s != sim->s) return "index matrix does not match s";
+    if(sim->index.kind == INDEX_XOR) sim->index.s = sim->s;
+    configString(config, 256, sim, indexName);
+    return NULL;
+}
+
+//read n inline trace lines from the client, return the data accesses kept or -1 if the stream ends early
+int readInline(FILE* in, long n, char** op, unsigned long** addr){
+    char line[SERVE_LINE];
+    char opText[8];
+    long got = 0;
+    *op = (char*) malloc(n ? n : 1);
+    *addr = (unsigned long*) malloc((n ? n : 1) * sizeof(unsigned long));
+    if(*op == NULL || *addr == NULL) return -1;
+    for(long i = 0; i < n; i++){
+        if(fgets(line, sizeof(line), in) == NULL) return -1;
+        if(sscanf(line, "%7s %lx", opText, &(*addr)[got]) != 2) continue;
+        if(opText[0] == 'I') continue;//same as parseBatch
+        (*op)[got++] = opText[0];
+    }
+    return (int) got;//n is capped at MAX_INLINE
+}
+
+//send one reply line, return -1 once the client can't be written to
+int reply(FILE* out, const char* fmt, ...){
+    va_list args;
+    va_start(args, fmt);
+    int n = vfprintf(out, fmt, args);
+    va_end(args);
+    return n < 0 || fflush(out) != 0 ? -1 : 0;
+}
+
+void* serveClient(void* arg){
+    int fd = (int)(long) arg;
+    FILE* in = fdopen(fd, "r");
+    FILE* out = fdopen(dup(fd), "w");
+    struct batch* batch = (struct batch*) malloc(sizeof(struct batch));
+    struct arena arena = {NULL, 0, 0, 0};//kept across requests, reset in between
+    char line[SERVE_LINE];
+    char config[256];
+    if(in == NULL || out == NULL || batch == NULL){
+        if(in != NULL) fclose(in);
+        if(out != NULL) fclose(out);
+        free(batch);
+        return NULL;
+    }
+    while(fgets(line, sizeof(line), in) != NULL){
+        struct sim sim;
+        char* trace;
+        long inlineCount;
+        const char* err;
+        int sent;
+        if(strncmp(line, "shutdown", 8) == 0){
+            reply(out, "ok\n");
+            shutdown(traces.listenFd, SHUT_RDWR);//wakes accept in serve
+            break;
+        }
+        if((err = parseRequest(line, &sim, config, &trace, &inlineCount)) != NULL){
+            if(reply(out, "error %s\n", err) != 0) break;
+            continue;
+        }
+        if(inlineCount >= 0){
+            char* op = NULL;
+            unsigned long* addr = NULL;
+            int n = readInline(in, inlineCount, &op, &addr);
+            resetArena(&arena);
+            if(n < 0) err = "short inline batch";
+            else if(alloSim(&sim, &arena) != 0) err = "no memory";
+            else simulateRecords(&sim, batch, op, addr, n);
+            free(op);
+            free(addr);
+            if(err != NULL) sent = reply(out, "error %s\n", err);
+            else sent = reply(out, "ok hits:%ld misses:%ld evictions:%ld source:inline\n", sim.hits, sim.miss, sim.evic);
+            if(n < 0 || sent != 0) break;
+            continue;
+        }
+        int parsed;
+        struct parsedTrace* p = acquireParsed(trace, batch, &parsed);
+        if(p == NULL){
+            if(reply(out, "error unreadable trace\n") != 0) break;
+            continue;
+        }
+        struct memo* m;
+        pthread_mutex_lock(&traces.lock);
+        for(m = p->memos; m != NULL && strcmp(m->config, config) != 0; m = m->next);
+        if(m != NULL){
+            sim.hits = m->hits;
+            sim.miss = m->miss;
+            sim.evic = m->evic;
+        }
+        pthread_mutex_unlock(&traces.lock);
+        if(m == NULL){
+            resetArena(&arena);
+            if(alloSim(&sim, &arena) != 0) err = "no memory";
+            else {
+                simulateRecords(&sim, batch, p->op, p->addr, p->n);
+                m = (struct memo*) malloc(sizeof(struct memo));
+                if(m != NULL){
+                    snprintf(m->config, sizeof(m->config), "%s", config);
+                    m->hits = sim.hits;
+                    m->miss = sim.miss;
+                    m->evic = sim.evic;
+                    pthread_mutex_lock(&traces.lock);
+                    m->next = p->memos;
+                    p->memos = m;
+                    pthread_mutex_unlock(&traces.lock);
+                    m = NULL;//freshly simulated, not a memo hit
+                }
+            }
+        }
+        releaseParsed(p);
+        if(err != NULL) sent = reply(out, "error %s\n", err);
+        else sent = reply(out, "ok hits:%ld misses:%ld evictions:%ld source:%s\n", sim.hits, sim.miss, sim.evic,
+                          m != NULL ? "memo" : parsed ? "parsed" : "warm");
+        if(sent != 0) break;//the client went away
+    }
+    fclose(in);
+    fclose(out);
+    free(batch);
+    freeArena(&arena);
+    return NULL;
+}
+
+//accept clients until a shutdown request, one thread each
+int serve(const char* path, size_t budget){
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0 || strlen(path) >= sizeof(addr.sun_path)) return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    struct stat st;
+    if(lstat(path, &st) == 0){
+        //only a stale socket from an earlier service is replaced, never a file given by mistake
+        if(!S_ISSOCK(st.st_mode)){
+            close(fd);
+            return -1;
+        }
+        unlink(path);
+    }
+    if(bind(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(fd, 64) != 0){
+        close(fd);
+        return -1;
+    }
+    traces.budget = budget;
+    traces.listenFd = fd;
+    signal(SIGPIPE, SIG_IGN);//a client hanging up mid-reply must not end the service
+    for(;;){
+        int conn = accept(fd, NULL, NULL);
+        if(conn < 0) break;//shut down
+        pthread_t thread;
+        if(pthread_create(&thread, NULL, serveClient, (void*)(long) conn) != 0){
+            close(conn);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    close(fd);
+    unlink(path);
+    return 0;
+}
+
+//send one trace= request to a running service, return 0 and fill sim on success
+int askService(const char* path, const char* config, const char* trace, struct sim* sim){
+    struct sockaddr_un addr;
+    char full[PATH_MAX];
+    char line[SERVE_LINE];
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0 || strlen(path) >= sizeof(addr.sun_path) || realpath(trace, full) == NULL) return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if(connect(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0){
+        close(fd);
+        return -1;
+    }
+    FILE* io = fdopen(fd, "r+");
+    if(io == NULL){
+        close(fd);
+        return -1;
+    }
+    //the service may run elsewhere in the tree, so the path goes over absolute
+    fprintf(io, "%s trace=%s\n", config, full);
+    fflush(io);
+    int ok = fgets(line, sizeof(line), io) != NULL &&
+        sscanf(line, "ok hits:%ld misses:%ld evictions:%ld", &sim->hits, &sim->miss, &sim->evic) == 3;
+    if(!ok) printf("service: %s", line);
+    fclose(io);
+    return ok ? 0 : -1;
+}
+
+//the per-run extras, for the modes that refuse them
+#define EXTRAS "-C, --tlb, --regions, --series, --latency, --victim-cache, --miss-cache, --profile or --pipeline"
+
+void usage(char* name){
+    printf("Usage: %s [-h] [-C] -s <num> -E <num> -b <num> -t <file>\n", name);
+    printf("       %s -s <num> -E <num> -b <num> [--jobs <n>] [--batch <list>] [-t <file>] [trace ...]\n", name);
+    printf("Options:\n");
+    printf("  -h              Print this help message.\n");
+    printf("  -s <num>        Number of set index bits.\n");
+    printf("  -E <num>        Number of lines per set.\n");
+    printf("  -b <num>        Number of block offset bits.\n");
+    printf("  -t <file>       Trace file, text or tracesynth binary.\n");
+    printf("  -C, --classify  Split misses into compulsory, capacity and conflict.\n");
+    printf("  --tlb <entries>:<ways>[:4K|2M|1G]   Model a first level TLB.\n");
+    printf("  --stlb <entries>:<ways>             Add a second level TLB (same page size).\n");
+    printf("  --walk-cost <cycles>                Cycles charged per page walk (default 30).\n");
+    printf("  --latency <hit>:<mem>[:<wb>[:<mlp>]]  Estimate cycles and AMAT from hit, memory and\n");
+    printf("                  writeback latencies, misses overlapping mlp at a time.\n");
+    printf("  --victim-cache <entries>  Add a fully associative victim cache that takes the main\n");
+    printf("                  cache's evictions and swaps lines back on a hit.\n");
+    printf("  --miss-cache <entries>    Add a fully associative miss cache holding recent misses.\n");
+    printf("  --bench         Report parse and simulate time, access count and peak RSS.\n");
+    printf("  --profile       Report time per phase and, on Linux, perf counters for the\n");
+    printf("                  simulate phase (cycles, instructions, LLC and branch misses).\n");
+    printf("  --profile-json <file>  Also write the profile as JSON.\n");
+    printf("  --regions <file>  Attribute accesses and evictions to the regions tracegen\n");
+    printf("                  records in .regions, with a per-set eviction matrix.\n");
+    printf("  --pipeline               Parse on a second thread while simulating.\n");
+    printf("  --huge-pages             Back cache state with 2MB transparent huge pages.\n");
+    printf("  --index xor|matrix:<file>|prime:<sets>  Hashed or non power of two set index.\n");
+    printf("  --batch <list>           Simulate every trace named in list (one per line),\n");
+    printf("                           plus any traces given after the options.\n");
+    printf("  --jobs <n>               Worker threads for batch mode (default: online CPUs).\n");
+    printf("  --way-index-above <E>    Use hashed O(1) set lookup above this associativity (default %d).\n",
+           DEFAULT_WAY_INDEX_THRESHOLD);
+    printf("  --no-run-skip            Send same-block repeats through the full LRU update.\n");
+    printf("  --share <trace>[:<mask>] Add a tenant to a shared cache, optionally limited to the\n");
+    printf("                           ways in a hex CAT mask. Repeat for each co-running trace.\n");
+    printf("  --quantum <records>      Records a tenant replays per turn (default 1).\n");
+    printf("  --ucp <accesses>         Partition ways by utility, recomputed at this interval.\n");
+    printf("  --diff <trace>           Compare -t <trace> against this one element by element, using\n");
+    printf("                           each trace's <trace>.regions (or --regions) for matrix shapes.\n");
+    printf("  --diff-tile <n>          Tile edge for the per-tile comparison (default 8).\n");
+    printf("  --diff-top <n>           Rows shown per table (default 10).\n");
+    printf("  --points <file>          Replay the representative intervals simpoint wrote for -t\n");
+    printf("                           and estimate the whole trace's counts.\n");
+    printf("  --serve <socket>         Answer simulation requests on a Unix socket until shut down.\n");
+    printf("  --trace-cache-mb <n>     Memory for parsed traces in service mode (default 1024).\n");
+    printf("  --connect <socket>       Ask a running service instead of simulating here.\n");
+    printf("  --series <file>          Write per-interval counts (CSV) to file.\n");
+    printf("  --series-binary          Write the series as binary records instead.\n");
+    printf("  --interval <accesses>    Interval length (default 100000).\n");
+    printf("  --interval-markers <file>  Also end intervals at the .marker addresses.\n");
+    printf("  --phase-threshold <rate> Miss rate jump flagged as a phase change (default 0.1).\n");
+}
+
+int main(int argc, char** argv){
+    double started = now();
+    int opt;
+    struct sim sim;
+    int classifyMisses = 0;
+    int bench = 0;
+    char* stlbArg = NULL;
+    char* traceName = NULL;
+    char* regionsName = NULL;
+    char* indexName = NULL;
+    char* listName = NULL;
+    int jobs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    char* seriesName = NULL;
+    char* markerName = NULL;
+    int seriesBinary = 0;
+    long interval = 100000;
+    double phaseThreshold = 0.1;
+    int pipeline = 0;
+    struct latency lat;
+    char* latencyArg = NULL;
+    struct buffer buf;
+    char* bufferArg = NULL;
+    int profile = 0;
+    char* profileJson = NULL;
+    struct phases ph = {0, 0, 0, 0, 0};
+    static struct shared shared;
+    char* diffName = NULL;
+    char* pointsName = NULL;
+    int diffTile = 8, diffTop = 10;
+    char* serveName = NULL;
+    char* connectName = NULL;
+    long traceCacheMB = 1024;
+    struct arena arena = {NULL, 0, 0, 0};
+    char config[256];
+    char key[RESULT_KEY_LEN];
+    int useStore;
+    FILE *t = NULL;
+    static struct option longOpts[] = {
+        {"classify", no_argument, NULL, 'C'},
+        {"tlb", required_argument, NULL, 'T'},
+        {"stlb", required_argument, NULL, 'U'},
+        {"walk-cost", required_argument, NULL, 'W'},
+        {"latency", required_argument, NULL, 'D'},
+        {"victim-cache", required_argument, NULL, 'v'},
+        {"miss-cache", required_argument, NULL, 'm'},
+        {"bench", no_argument, NULL, 'B'},
+        {"profile", no_argument, NULL, 'F'},
+        {"profile-json", required_argument, NULL, 'Z'},
+        {"regions", required_argument, NULL, 'R'},
+        {"pipeline", no_argument, NULL, 'L'},
+        {"huge-pages", no_argument, NULL, 'H'},
+        {"index", required_argument, NULL, 'X'},
+        {"batch", required_argument, NULL, 'A'},
+        {"jobs", required_argument, NULL, 'J'},
+        {"way-index-above", required_argument, NULL, 'Q'},
+        {"no-run-skip", no_argument, NULL, 'N'},
+        {"share", required_argument, NULL, 'M'},
+        {"quantum", required_argument, NULL, 'q'},
+        {"ucp", required_argument, NULL, 'u'},
+        {"points", required_argument, NULL, 'p'},
+        {"diff", required_argument, NULL, 'd'},
+        {"diff-tile", required_argument, NULL, 'i'},
+        {"diff-top", required_argument, NULL, 'k'},
+        {"serve", required_argument, NULL, 'V'},
+        {"trace-cache-mb", required_argument, NULL, 'G'},
+        {"connect", required_argument, NULL, 'O'},
+        {"series", required_argument, NULL, 'S'},
+        {"series-binary", no_argument, NULL, 'Y'},
+        {"interval", required_argument, NULL, 'I'},
+        {"interval-markers", required_argument, NULL, 'K'},
+        {"phase-threshold", required_argument, NULL, 'P'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    memset(&sim, 0, sizeof(sim));
+    sim.walkCost = 30;
+    sim.wayThreshold = DEFAULT_WAY_INDEX_THRESHOLD;
+    sim.runSkip = 1;
+    while((opt = getopt_long(argc, argv, "s:E:b:t:Ch", longOpts, NULL)) != -1){
+	switch(opt){
+	case 's':
+	    sim.s = atoi(optarg);
+	    break;
+	case 'E':
+	    sim.e = atoi(optarg);
+	    break;
+	case 'b':
+	    sim.b = atoi(optarg);
+	    break;
+	case 't':
+	    t = fopen(optarg, "r");
+	    traceName = optarg;
+		printf("%s", optarg);
+	    break;
+	case 'C':
+	    classifyMisses = 1;
+	    break;
+	case 'T':
+	    if(parseTLB(optarg, &sim.tlb1, 12) != 0){
+	        printf("bad --tlb value: %s\n", optarg);
+	        return 0;
+	    }
+	    break;
+	case 'U':
+	    //page size of the second level follows the first, so it is parsed after the loop
+	    stlbArg = optarg;
+	    break;
+	case 'W':
+	    sim.walkCost = atoi(optarg);
+	    break;
+	case 'D':
+	    if(parseLatency(optarg, &lat) != 0){
+	        printf("bad --latency value: %s\n", optarg);
+	        return 0;
+	    }
+	    latencyArg = optarg;
+	    break;
+	case 'v':
+	case 'm':
+	    if(parseBuffer(optarg, opt == 'v' ? BUFFER_VICTIM : BUFFER_MISS, &buf) != 0){
+	        printf("bad --%s value: %s\n", opt == 'v' ? "victim-cache" : "miss-cache", optarg);
+	        return 0;
+	    }
+	    bufferArg = optarg;
+	    break;
+	case 'B':
+	    bench = 1;
+	    break;
+	case 'F':
+	    profile = 1;
+	    break;
+	case 'Z':
+	    profile = 1;
+	    profileJson = optarg;
+	    break;
+	case 'R':
+	    regionsName = optarg;
+	    break;
+	case 'L':
+	    pipeline = 1;
+	    break;
+	case 'H':
+	    arena.huge = 1;
+	    break;
+	case 'X':
+	    if(parseIndex(optarg, &sim.index) != 0){
+	        printf("bad --index value: %s\n", optarg);
+	        return 0;
+	    }
+	    indexName = optarg;
+	    break;
+	case 'A':
+	    listName = optarg;
+	    break;
+	case 'J':
+	    jobs = atoi(optarg);
+	    break;
+	case 'Q':
+	    sim.wayThreshold = atoi(optarg);
+	    break;
+	case 'N':
+	    sim.runSkip = 0;
+	    break;
+	case 'M':
+	    if(addTenant(&shared, optarg) != 0){
+	        printf("at most %d tenants\n", MAX_TENANTS);
+	        return 0;
+	    }
+	    break;
+	case 'q':
+	    shared.quantum = atol(optarg);
+	    break;
+	case 'u':
+	    shared.ucpInterval = atol(optarg);
+	    break;
+	case 'p':
+	    pointsName = optarg;
+	    break;
+	case 'd':
+	    diffName = optarg;
+	    break;
+	case 'i':
+	    diffTile = atoi(optarg);
+	    break;
+	case 'k':
+	    diffTop = atoi(optarg);
+	    break;
+	case 'V':
+	    serveName = optarg;
+	    break;
+	case 'G':
+	    traceCacheMB = atol(optarg);
+	    break;
+	case 'O':
+	    connectName = optarg;
+	    break;
+	case 'S':
+	    seriesName = optarg;
+	    break;
+	case 'Y':
+	    seriesBinary = 1;
+	    break;
+	case 'I':
+	    interval = atol(optarg);
+	    break;
+	case 'K':
+	    markerName = optarg;
+	    break;
+	case 'P':
+	    phaseThreshold = atof(optarg);
+	    break;
+	case 'h':
+	    usage(argv[0]);
+	    return 0;
+	case '?': //if we get unexpected input abort program
+	    return 0;
+	default:
+	    break;
+	}
+    }
+    //s = atoi(argv[2]);
+    //e = atoi(argv[4]);
+    //b = atoi(argv[6]);
+    //t = fopen(argv[8], "r");
+    if(stlbArg != NULL && (sim.tlb1.e == 0 || parseTLB(stlbArg, &sim.tlb2, sim.tlb1.pageBits) != 0)){
+        printf("bad --stlb value (needs --tlb): %s\n", stlbArg);
+        return 0;
+    }
+    //--serve takes s, E and b from each request instead
+    if(serveName == NULL && (sim.s < 0 || sim.e <= 0 || sim.b < 0 || sim.s + sim.b > 63 || tooManyLines(simSets(&sim), sim.e))){
+        printf("need s, E and b with s + b <= 63 and at most %lu lines in the cache\n", MAX_LINES);
+        return 0;
+    }
+    if(sim.index.kind == INDEX_MATRIX && sim.index.s != sim.s){
+        printf("--index matrix needs one row per set bit (%d rows for s=%d)\n", sim.index.s, sim.s);
+        return 0;
+    }
+    if(sim.index.kind == INDEX_XOR) sim.index.s = sim.s;
+    configString(config, sizeof(config), &sim, indexName);
+    //modes that only report the core counters refuse the per-run extras
+    int extrasBesidesRegions = classifyMisses || seriesName != NULL || sim.tlb1.e != 0 || pipeline ||
+                               latencyArg != NULL || bufferArg != NULL || profile;
+    int extras = extrasBesidesRegions || regionsName != NULL;
+    if(shared.count > 0){
+        if(t != NULL || listName != NULL || extras){
+            printf("--share can't be combined with -t, --batch, " EXTRAS "\n");
+            return 0;
+        }
+        if(shared.ucpInterval > 0 && sim.e < shared.count){
+            printf("--ucp needs at least one way per tenant\n");
+            return 0;
+        }
+        shared.s = sim.s;
+        shared.e = sim.e;
+        shared.b = sim.b;
+        shared.index = sim.index;
+        if(shared.quantum <= 0) shared.quantum = 1;
+        if(alloShared(&shared, &arena) != 0){
+            printf("could not set up the shared cache (bad mask or out of memory)\n");
+            return 0;
+        }
+        if(runShared(&shared) == 0) printShared(&shared);
+        freeArena(&arena);
+        return 0;
+    }
+    if(diffName != NULL){
+        static struct diffSide x, y;
+        struct batch* diffBatch = (struct batch*) malloc(sizeof(struct batch));
+        unsigned long sets = sim.index.kind == INDEX_PRIME ? sim.index.sets : 1UL << sim.s;
+        int same = 1;
+        if(t == NULL || listName != NULL || optind < argc || diffTile <= 0 || diffBatch == NULL){
+            printf("--diff needs -t <trace> to compare against and a positive --diff-tile\n");
+            return 0;
+        }
+        //--regions is allowed, it's where --diff finds the matrices when a trace has no .regions of its own
+        if(extrasBesidesRegions){
+            printf("--diff can't be combined with -C, --tlb, --series, --latency, --victim-cache, --miss-cache, --profile or --pipeline\n");
+            return 0;
+        }
+        fclose(t);
+        if(diffOpen(&x, traceName, regionsName, sets) != 0 || diffOpen(&y, diffName, regionsName, sets) != 0){
+            printf("--diff needs <trace>.regions next to each trace, or --regions\n");
+            return 0;
+        }
+        //elements are matched by region and position, so the matrices must agree
+        same = x.regions->count == y.regions->count;
+        for(int i = 0; same && i < x.regions->count; i++){
+            same = strcmp(x.regions->names[i], y.regions->names[i]) == 0 &&
+                   x.regions->rows[i] == y.regions->rows[i] && x.regions->cols[i] == y.regions->cols[i];
+        }
+        if(!same){
+            printf("the two traces' regions don't describe the same matrices\n");
+            return 0;
+        }
+        if(diffRun(&x, &sim, sim.b, diffBatch) != 0 || diffRun(&y, &sim, sim.b, diffBatch) != 0){
+            printf("could not simulate %s or %s\n", traceName, diffName);
+            return 0;
+        }
+        printf("\n");//-t has already echoed the trace name
+        printDiff(&x, &y, diffTile, diffTop);
+        return 0;
+    }
+    if(serveName != NULL){
+        if(extras){
+            printf("--serve can't be combined with " EXTRAS "\n");
+            return 0;
+        }
+        if(serve(serveName, (size_t) traceCacheMB << 20) != 0) printf("could not listen on %s\n", serveName);
+        return 0;
+    }
+    if(listName != NULL || optind < argc){
+        char** paths = NULL;
+        int count = listName != NULL ? readTraceList(listName, &paths) : 0;
+        if(extras){
+            printf("batch mode can't be combined with " EXTRAS "\n");
+            return 0;
+        }
+        char** all = (char**) malloc((count + argc - optind + 1) * sizeof(char*));
+        if(all == NULL) return 0;
+        for(int i = 0; i < count; i++) all[i] = paths[i];
+        if(traceName != NULL){
+            all[count++] = traceName;//-t joins the batch rather than being dropped
+            printf("\n");//-t has already echoed the trace name
+        }
+        if(t != NULL) fclose(t);
+        for(int i = optind; i < argc; i++) all[count++] = argv[i];
+        runBatch(&sim, all, count, jobs > 0 ? jobs : 1, arena.huge, config);
+        free(all);
+        free(paths);//the path strings live until exit
+        return 0;
+    }
+    if(t == NULL) return 0; //if the file didn't open exit the program
+    if(connectName != NULL){
+        //the service only reports the core counters, like batch mode
+        if(extras){
+            printf("--connect can't be combined with " EXTRAS "\n");
+            fclose(t);
+            return 0;
+        }
+        if(askService(connectName, config, traceName, &sim) == 0) printSummaryLong(sim.hits, sim.miss, sim.evic);
+        fclose(t);
+        return 0;
+    }
+    if(pointsName != NULL){
+        //like batch mode, only the core counters are estimated
+        struct point* points;
+        long accesses, replayed = 0;
+        double est[3];
+        if(extras){
+            printf("--points can't be combined with " EXTRAS "\n");
+            fclose(t);
+            return 0;
+        }
+        int count = loadPoints(pointsName, &points, &accesses);
+        struct batch* batch = count > 0 ? (struct batch*) malloc(sizeof(struct batch)) : NULL;
+        if(count <= 0 || batch == NULL){
+            printf("could not read points from %s\n", pointsName);
+            if(count > 0) free(points);
+            fclose(t);
+            return 0;
+        }
+        if(runPoints(&sim, t, points, count, batch, &arena, est) != 0){
+            printf("%s is shorter than %s says, or out of memory\n", traceName, pointsName);
+            free(points);
+            free(batch);
+            fclose(t);
+            freeArena(&arena);
+            return 0;
+        }
+        for(int i = 0; i < count; i++) replayed += points[i].warm + points[i].length;
+        printf("estimate hits:%.0f misses:%.0f evictions:%.0f\n", est[0], est[1], est[2]);
+        //the summary is integral, so it is left out when an estimate doesn't fit
+        if(est[0] + 0.5 < (double) LONG_MAX && est[1] + 0.5 < (double) LONG_MAX && est[2] + 0.5 < (double) LONG_MAX)
+            printSummaryLong((long)(est[0] + 0.5), (long)(est[1] + 0.5), (long)(est[2] + 0.5));
+        printf("points:%d replayed:%ld of %ld accesses (%.2f%%)\n", count, replayed, accesses,
+               accesses ? 100.0 * replayed / accesses : 0.0);
+        free(points);
+        free(batch);
+        fclose(t);
+        freeArena(&arena);
+        return 0;
+    }
+    //plain runs can be answered from the result store (enabled by CSIM_STORE)
+    useStore = !classifyMisses && sim.tlb1.e == 0 && !bench && !profile && regionsName == NULL && seriesName == NULL && latencyArg == NULL &&
+               bufferArg == NULL;
+    if(useStore && resultKey(traceName, config, CSIM_VERSION, key) != 0) useStore = 0;
+    if(useStore && loadResult(key, &sim.hits, &sim.miss, &sim.evic)){
+        printSummaryLong(sim.hits, sim.miss, sim.evic);
+        return 0;
+    }
+    if(alloSim(&sim, &arena) != 0){
+        printf("could not allocate %lu bytes of cache state\n", (unsigned long) arena.failed);
+        freeArena(&arena);
+        return 0; //if the cache wasn't allocated exit the program
+    }
+    if(regionsName != NULL){
+        sim.regions = loadRegions(regionsName, sim.sets);
+        if(sim.regions == NULL){
+            printf("could not read regions from %s\n", regionsName);
+            return 0;
+        }
+    }
+    if(seriesName != NULL){
+        sim.series = openSeries(seriesName, seriesBinary, interval, markerName, phaseThreshold);
+        if(sim.series == NULL){
+            printf("could not open series %s (or markers %s)\n", seriesName, markerName ? markerName : "-");
+            return 0;
+        }
+    }
+    if(classifyMisses){
+        sim.sh = alloShadow(sim.sets * sim.e);
+        if(sim.sh == NULL) return 0;
+    }
+    if(latencyArg != NULL){
+        lat.writebacks = 0;
+        if(alloDirty(&arena, &lat, sim.sets * sim.e) != 0) return 0;
+        sim.lat = &lat;
+    }
+    if(bufferArg != NULL){
+        buf.lat = sim.lat;//NULL without --latency
+        if(alloBuffer(&arena, &buf) != 0) return 0;
+        sim.buf = &buf;
+    }
+
+    struct perf perf;
+    if(profile && perfOpen(&perf) == 0) sim.perf = &perf;
+    double mark = now();
+    long accesses = 0;
+    ph.open = mark - started;
+    if(pipeline){
+        //one buffer per ring slot, allocated once up front
+        static struct ring ring;
+        struct reader rd = {&ring, t, isBinaryTrace(t), sim.s, sim.b, &sim.index, 0, 0};
+        pthread_t reader;
+        for(int i = 0; i < RING_SLOTS; i++){
+            ring.slots[i] = (struct batch*) malloc(sizeof(struct batch));
+            if(ring.slots[i] == NULL) return 0;
+        }
+        if(pthread_create(&reader, NULL, readTrace, &rd) != 0) return 0;
+        accesses = simPipelined(&sim, &ring);
+        ph.sim = now() - mark;//includes any time spent waiting on the reader
+        pthread_join(reader, NULL);
+        ph.parse = rd.parseTime;
+        ph.decode = rd.decodeTime;
+        for(int i = 0; i < RING_SLOTS; i++) free(ring.slots[i]);
+    } else {
+        struct batch* batch = (struct batch*) malloc(sizeof(struct batch));
+        if(batch == NULL) return 0;
+        accesses = simulateStream(&sim, t, batch, &ph);
+        free(batch);
+    }
+    mark = now();
+
+    printSummaryLong(sim.hits, sim.miss, sim.evic);
+    if(useStore) saveResult(key, sim.hits, sim.miss, sim.evic);
+    if(sim.sh != NULL){
+        printf("compulsory:%ld capacity:%ld conflict:%ld\n", sim.sh->compulsory, sim.sh->capacity, sim.sh->conflict);
+        freeShadow(sim.sh);
+    }
+    if(sim.tlb1.sets != NULL){
+        printf("tlb hits:%ld misses:%ld", sim.tlb1.hits, sim.tlb1.misses);
+        if(sim.tlb2.sets != NULL) printf(" stlb hits:%ld misses:%ld", sim.tlb2.hits, sim.tlb2.misses);
+        printf(" walks:%ld walk-cycles:%ld\n", sim.walks, (long) sim.walks * sim.walkCost);
+    }
+    if(sim.buf != NULL){
+        printf("%s %s:%ld misses:%ld evictions:%ld memory-misses:%ld\n",
+               buf.kind == BUFFER_VICTIM ? "victim-cache" : "miss-cache", buf.kind == BUFFER_VICTIM ? "swaps" : "hits",
+               buf.hits, buf.misses, buf.evictions, (long) sim.miss - buf.hits);
+    }
+    if(sim.lat != NULL){
+        long accessCount = (long) sim.hits + sim.miss;
+        //misses the buffer catches don't go to memory
+        long fetches = sim.buf != NULL ? sim.miss - buf.hits : sim.miss;
+        double stall = ((double) fetches * lat.mem + (double) lat.writebacks * lat.wb) / lat.mlp;
+        double cycles = (double) accessCount * lat.hit + stall;
+        if(sim.tlb1.sets != NULL) cycles += (double) sim.walks * sim.walkCost;
+        printf("latency cycles:%.0f stall-cycles:%.0f writebacks:%ld amat:%.2f\n",
+               cycles, stall, lat.writebacks, accessCount ? cycles / accessCount : 0.0);
+    }
+    if(sim.series != NULL) printf("phase changes:%d\n", closeSeries(sim.series, &sim));
+    if(sim.regions != NULL){
+        printRegions(sim.regions, sim.sets);
+        freeRegions(sim.regions);
+    }
+    if(bench){
+        struct rusage ru;
+        getrusage(RUSAGE_SELF, &ru);
+        printf("bench accesses:%ld parse-sec:%.6f sim-sec:%.6f max-rss-kb:%ld\n",
+               accesses, ph.parse + ph.decode, ph.sim, ru.ru_maxrss);
+        printf("arena used-bytes:%lu mapped-bytes:%lu huge-pages:%d\n",
+               (unsigned long) arena.used, (unsigned long) arena.mapped, arena.huge);
+    }
+    if(profile){
+        FILE* json = NULL;
+        if(profileJson != NULL && (json = fopen(profileJson, "w")) == NULL) printf("could not write %s\n", profileJson);
+        ph.report = now() - mark;
+        perfClose(&perf);
+        printProfile(&ph, &perf, accesses, json);
+        if(json != NULL) fclose(json);
+    }
+    freeArena(&arena);
     return 0;
 }
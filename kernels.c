@@ -0,0 +1,158 @@
+/*
+ * kernels.c - Loops other than transpose, evaluated the same way
+ *
+ * Each kernel has a prototype of the form:
+ * void kernel(int M, int N, void* args[]);
+ * and is registered together with a straightforward reference version
+ * and a descriptor for each argument (see cachelab.h). tracegen -K runs
+ * a kernel between the trace markers and checks its outputs against
+ * the reference; test-trans -k scores every kernel on the simulated
+ * cache like the transpose functions.
+ */
+#include <stdio.h>
+#include "cachelab.h"
+
+/*
+ * matmul - C = A * B for A N x M and B M x N, in 8x8 tiles of C with the
+ *     k loop blocked too, so a tile of B stays cached while it is reused
+ */
+char matmul_desc[] = "Blocked matrix multiply";
+void matmul(int M, int N, void* args[])
+{
+    int (*A)[M] = args[0];
+    int (*B)[N] = args[1];
+    int (*C)[N] = args[2];
+    int i, j, k, ii, jj, kk, sum;
+
+    for(i = 0; i < N; i++)
+	for(j = 0; j < N; j++)
+	    C[i][j] = 0;
+    for(ii = 0; ii < N; ii += 8)
+	for(jj = 0; jj < N; jj += 8)
+	    for(kk = 0; kk < M; kk += 8)
+		for(i = ii; i < ii + 8 && i < N; i++)
+		    for(j = jj; j < jj + 8 && j < N; j++){
+			sum = C[i][j];
+			for(k = kk; k < kk + 8 && k < M; k++)
+			    sum += A[i][k] * B[k][j];
+			C[i][j] = sum;
+		    }
+}
+
+void matmul_ref(int M, int N, void* args[])
+{
+    int (*A)[M] = args[0];
+    int (*B)[N] = args[1];
+    int (*C)[N] = args[2];
+    int i, j, k, sum;
+
+    for(i = 0; i < N; i++)
+	for(j = 0; j < N; j++){
+	    sum = 0;
+	    for(k = 0; k < M; k++)
+		sum += A[i][k] * B[k][j];
+	    C[i][j] = sum;
+	}
+}
+
+static const kernel_arg_t matmul_args[] = {
+    {"A", KARG_IN, 'N', 'M'},
+    {"B", KARG_IN, 'M', 'N'},
+    {"C", KARG_OUT, 'N', 'N'},
+};
+
+/*
+ * stencil - 5-point average of an N x M grid, edges copied. The three
+ *     input rows in use are walked together so each is read once per
+ *     output row.
+ */
+char stencil_desc[] = "5-point stencil";
+void stencil(int M, int N, void* args[])
+{
+    int (*in)[M] = args[0];
+    int (*out)[M] = args[1];
+    int i, j, left, mid, right;
+
+    for(i = 0; i < N; i++){
+	if(i == 0 || i == N - 1 || M < 3){
+	    for(j = 0; j < M; j++)
+		out[i][j] = in[i][j];
+	    continue;
+	}
+	out[i][0] = in[i][0];
+	left = in[i][0];
+	mid = in[i][1];
+	for(j = 1; j < M - 1; j++){
+	    right = in[i][j + 1];
+	    out[i][j] = (left + mid + right + in[i - 1][j] + in[i + 1][j]) / 5;
+	    left = mid;
+	    mid = right;
+	}
+	out[i][M - 1] = in[i][M - 1];
+    }
+}
+
+void stencil_ref(int M, int N, void* args[])
+{
+    int (*in)[M] = args[0];
+    int (*out)[M] = args[1];
+    int i, j;
+
+    for(i = 0; i < N; i++)
+	for(j = 0; j < M; j++){
+	    if(i == 0 || i == N - 1 || j == 0 || j == M - 1)
+		out[i][j] = in[i][j];
+	    else
+		out[i][j] = (in[i][j - 1] + in[i][j] + in[i][j + 1] +
+			     in[i - 1][j] + in[i + 1][j]) / 5;
+	}
+}
+
+static const kernel_arg_t stencil_args[] = {
+    {"in", KARG_IN, 'N', 'M'},
+    {"out", KARG_OUT, 'N', 'M'},
+};
+
+/*
+ * gather - out[i][j] = src[idx[i][j]], treating src as a flat array
+ */
+char gather_desc[] = "Indexed gather";
+void gather(int M, int N, void* args[])
+{
+    int* src = args[0];
+    int (*idx)[M] = args[1];
+    int (*out)[M] = args[2];
+    int i, j;
+
+    for(i = 0; i < N; i++)
+	for(j = 0; j < M; j++)
+	    out[i][j] = src[idx[i][j]];
+}
+
+void gather_ref(int M, int N, void* args[])
+{
+    int* src = args[0];
+    int* idx = args[1];
+    int* out = args[2];
+    int k;
+
+    for(k = 0; k < M * N; k++)
+	out[k] = src[idx[k]];
+}
+
+static const kernel_arg_t gather_args[] = {
+    {"src", KARG_IN, 'N', 'M'},
+    {"idx", KARG_INDEX, 'N', 'M'},
+    {"out", KARG_OUT, 'N', 'M'},
+};
+
+/*
+ * registerKernels - This function registers the kernels with the driver,
+ *     the same way registerFunctions does for transposes.
+ */
+void registerKernels()
+{
+    registerKernel(matmul, matmul_ref, matmul_desc, 3, matmul_args);
+    registerKernel(stencil, stencil_ref, stencil_desc, 2, stencil_args);
+    registerKernel(gather, gather_ref, gather_desc, 3, gather_args);
+}
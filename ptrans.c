@@ -0,0 +1,378 @@
+/*
+ * ptrans.c - Native multi-threaded transpose B = A^T for large matrices,
+ * and a benchmark of how it scales from one thread to all cores.
+ *
+ * The kernels in trans.c are tuned for the simulated 1KB cache and run
+ * single-threaded under valgrind. This one runs on the host: the matrix
+ * is cut into blocks sized for the real L2 (or into tile rows), blocks
+ * are transposed tile by tile with tiles sized for the real L1, and a
+ * pool of threads shares the blocks out by work stealing. Cache sizes
+ * come from sysfs.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Cache sizes used when sysfs can't be read */
+#define DEFAULT_L1 (32 * 1024)
+#define DEFAULT_L2 (1024 * 1024)
+
+/* Command line settings */
+static long M = 8192, N = 8192;     /* A is N rows of M, B is M rows of N */
+static int max_threads = 0;         /* 0: all online cores */
+static long tile = 0, block = 0;    /* 0: derive from the cache sizes */
+static int row_tasks = 0;           /* -r: one task per tile row */
+static int repeat = 3;
+
+/*
+ * A task queue is a range [top, bottom) of task numbers. The owner takes
+ * tasks from the bottom, thieves take half of what is left from the top.
+ */
+struct deque {
+    pthread_mutex_t lock;
+    long top, bottom;
+} __attribute__((aligned(64)));
+
+/* The thread pool; workers with id >= active sit a run out */
+struct pool {
+    pthread_t* threads;
+    struct deque* queues;
+    pthread_barrier_t start, end;
+    int size, active, quit;
+    const int* A;
+    int* B;
+    long task_rows, task_cols;      /* task shape in elements */
+    long tasks_per_row, tasks;
+    long steals;
+};
+
+static struct pool pool;
+
+/*
+ * cache_size - Size in bytes of the level-`level` data cache of cpu0,
+ * or 0 if sysfs doesn't list one
+ */
+static long cache_size(int level)
+{
+    char path[128], type[32];
+    int index, lvl;
+    long size;
+    char unit;
+    FILE* fp;
+
+    for (index = 0; index < 16; index++) {
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu0/cache/index%d/level", index);
+        if ((fp = fopen(path, "r")) == NULL)
+            break;
+        if (fscanf(fp, "%d", &lvl) != 1)
+            lvl = -1;
+        fclose(fp);
+        if (lvl != level)
+            continue;
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu0/cache/index%d/type", index);
+        if ((fp = fopen(path, "r")) == NULL)
+            continue;
+        if (fscanf(fp, "%31s", type) != 1)
+            type[0] = '\0';
+        fclose(fp);
+        if (strcmp(type, "Instruction") == 0)
+            continue;
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu0/cache/index%d/size", index);
+        if ((fp = fopen(path, "r")) == NULL)
+            continue;
+        unit = 'B';
+        if (fscanf(fp, "%ld%c", &size, &unit) < 1)
+            size = 0;
+        fclose(fp);
+        if (unit == 'K')
+            size <<= 10;
+        else if (unit == 'M')
+            size <<= 20;
+        return size;
+    }
+    return 0;
+}
+
+/*
+ * fit_square - Largest power of two edge such that an A tile and a B
+ * tile of ints together take at most half of `bytes`, leaving the rest
+ * of the cache for everything else
+ */
+static long fit_square(long bytes)
+{
+    long edge = 4;
+    while (2 * (2 * edge) * (2 * edge) * (long)sizeof(int) <= bytes / 2)
+        edge *= 2;
+    return edge;
+}
+
+/* Transpose one task, tile by tile */
+static void run_task(long task)
+{
+    long r0 = task / pool.tasks_per_row * pool.task_rows;
+    long c0 = task % pool.tasks_per_row * pool.task_cols;
+    long r1 = r0 + pool.task_rows < N ? r0 + pool.task_rows : N;
+    long c1 = c0 + pool.task_cols < M ? c0 + pool.task_cols : M;
+    long ti, tj, i, j, iend, jend;
+    const int* A = pool.A;
+    int* B = pool.B;
+
+    for (ti = r0; ti < r1; ti += tile) {
+        iend = ti + tile < r1 ? ti + tile : r1;
+        for (tj = c0; tj < c1; tj += tile) {
+            jend = tj + tile < c1 ? tj + tile : c1;
+            for (i = ti; i < iend; i++)
+                for (j = tj; j < jend; j++)
+                    B[j * N + i] = A[i * M + j];
+        }
+    }
+}
+
+/* Take a task from the bottom of our own queue; -1 if it is empty */
+static long pop_task(struct deque* q)
+{
+    long task = -1;
+    pthread_mutex_lock(&q->lock);
+    if (q->top < q->bottom)
+        task = --q->bottom;
+    pthread_mutex_unlock(&q->lock);
+    return task;
+}
+
+/*
+ * steal - Move the upper half of some other worker's remaining range
+ * into our empty queue. Returns 0 once every queue is empty.
+ */
+static int steal(int self)
+{
+    int k, victim;
+    long top, half;
+    struct deque* q;
+
+    for (k = 1; k < pool.active; k++) {
+        victim = (self + k) % pool.active;
+        q = &pool.queues[victim];
+        pthread_mutex_lock(&q->lock);
+        half = (q->bottom - q->top + 1) / 2;
+        top = q->top;
+        q->top += half;
+        pthread_mutex_unlock(&q->lock);
+        if (half > 0) {
+            q = &pool.queues[self];
+            pthread_mutex_lock(&q->lock);
+            q->top = top;
+            q->bottom = top + half;
+            pthread_mutex_unlock(&q->lock);
+            __atomic_fetch_add(&pool.steals, 1, __ATOMIC_RELAXED);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void* worker(void* arg)
+{
+    int self = (int)(long)arg;
+    long task;
+
+    for (;;) {
+        pthread_barrier_wait(&pool.start);
+        if (pool.quit)
+            return NULL;
+        if (self < pool.active) {
+            do {
+                while ((task = pop_task(&pool.queues[self])) >= 0)
+                    run_task(task);
+            } while (steal(self));
+        }
+        pthread_barrier_wait(&pool.end);
+    }
+}
+
+static void start_pool(int size)
+{
+    int i;
+    pool.size = size;
+    pool.threads = malloc(size * sizeof(pthread_t));
+    if (pool.threads == NULL ||
+        posix_memalign((void**)&pool.queues, 64, size * sizeof(struct deque))) {
+        fprintf(stderr, "ptrans: out of memory\n");
+        exit(1);
+    }
+    pthread_barrier_init(&pool.start, NULL, size + 1);
+    pthread_barrier_init(&pool.end, NULL, size + 1);
+    for (i = 0; i < size; i++) {
+        pthread_mutex_init(&pool.queues[i].lock, NULL);
+        pthread_create(&pool.threads[i], NULL, worker, (void*)(long)i);
+    }
+}
+
+static void stop_pool(void)
+{
+    int i;
+    pool.quit = 1;
+    pthread_barrier_wait(&pool.start);
+    for (i = 0; i < pool.size; i++)
+        pthread_join(pool.threads[i], NULL);
+    free(pool.threads);
+    free(pool.queues);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * transpose - One parallel transpose on `threads` workers. Each worker
+ * starts with a contiguous share of the tasks, so neighbouring blocks of
+ * A stay on one core until someone runs dry and steals. Returns seconds.
+ */
+static double transpose(const int* A, int* B, int threads)
+{
+    int k;
+    double t0;
+
+    pool.A = A;
+    pool.B = B;
+    pool.active = threads;
+    for (k = 0; k < threads; k++) {
+        pool.queues[k].top = pool.tasks * k / threads;
+        pool.queues[k].bottom = pool.tasks * (k + 1) / threads;
+    }
+    t0 = now();
+    pthread_barrier_wait(&pool.start);
+    pthread_barrier_wait(&pool.end);
+    return now() - t0;
+}
+
+/* Check B against A; the values in A encode their own position */
+static int is_transpose(const int* B)
+{
+    long i, j;
+    for (j = 0; j < M; j++)
+        for (i = 0; i < N; i++)
+            if (B[j * N + i] != (int)(i * M + j)) {
+                printf("Error: B[%ld][%ld] is wrong\n", j, i);
+                return 0;
+            }
+    return 1;
+}
+
+/*
+ * usage - Print usage info
+ */
+static void usage(char* argv[])
+{
+    printf("Usage: %s [-h] [-r] [-M <cols>] [-N <rows>] [-p <threads>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -M <cols>     Columns of A (default 8192)\n");
+    printf("  -N <rows>     Rows of A (default 8192)\n");
+    printf("  -p <threads>  Largest thread count to measure (default all cores)\n");
+    printf("  -T <edge>     Tile edge (default: sized for L1)\n");
+    printf("  -K <edge>     Block edge (default: sized for L2)\n");
+    printf("  -r            Split the matrix into tile rows instead of blocks\n");
+    printf("  -R <runs>     Runs per thread count, the fastest is kept (default 3)\n");
+    printf("Example: %s -M 16384 -N 16384 -p 64\n", argv[0]);
+}
+
+int main(int argc, char* argv[])
+{
+    int c, threads, run;
+    long l1, l2, i, n;
+    double best, t, base = 0;
+    int* A;
+    int* B;
+
+    while ((c = getopt(argc, argv, "M:N:p:T:K:rR:h")) != -1) {
+        switch (c) {
+        case 'M': M = atol(optarg); break;
+        case 'N': N = atol(optarg); break;
+        case 'p': max_threads = atoi(optarg); break;
+        case 'T': tile = atol(optarg); break;
+        case 'K': block = atol(optarg); break;
+        case 'r': row_tasks = 1; break;
+        case 'R': repeat = atoi(optarg); break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+    if (max_threads <= 0)
+        max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (M <= 0 || N <= 0 || max_threads <= 0 || repeat <= 0) {
+        printf("Error: sizes, threads and runs must be positive\n");
+        exit(1);
+    }
+
+    l1 = cache_size(1);
+    l2 = cache_size(2);
+    if (tile <= 0)
+        tile = fit_square(l1 ? l1 : DEFAULT_L1);
+    if (block <= 0)
+        block = fit_square(l2 ? l2 : DEFAULT_L2);
+    if (block < tile)
+        block = tile;
+    block -= block % tile;
+    pool.task_rows = row_tasks ? tile : block;
+    pool.task_cols = row_tasks ? M : block;
+    pool.tasks_per_row = (M + pool.task_cols - 1) / pool.task_cols;
+    pool.tasks = (N + pool.task_rows - 1) / pool.task_rows * pool.tasks_per_row;
+
+    n = M * N;
+    if (posix_memalign((void**)&A, 64, n * sizeof(int)) ||
+        posix_memalign((void**)&B, 64, n * sizeof(int))) {
+        fprintf(stderr, "ptrans: can't allocate two %ldx%ld matrices\n", N, M);
+        exit(1);
+    }
+    for (i = 0; i < n; i++)
+        A[i] = (int)i;
+
+    printf("A %ldx%ld, L1 %ldK, L2 %ldK%s, tile %ld, %s %ld, %ld tasks\n",
+           N, M, (l1 ? l1 : DEFAULT_L1) >> 10, (l2 ? l2 : DEFAULT_L2) >> 10,
+           l1 && l2 ? "" : " (defaults)", tile,
+           row_tasks ? "rows of" : "block", row_tasks ? tile : block, pool.tasks);
+    printf("%8s%12s%10s%10s%10s%8s\n",
+           "Threads", "Seconds", "GB/s", "Speedup", "Effic", "Steals");
+
+    start_pool(max_threads);
+    threads = 1;
+    for (;;) {
+        best = 0;
+        pool.steals = 0;
+        memset(B, 0, n * sizeof(int));
+        for (run = 0; run < repeat; run++) {
+            t = transpose(A, B, threads);
+            if (run == 0 || t < best)
+                best = t;
+        }
+        if (!is_transpose(B))
+            exit(1);
+        if (threads == 1)
+            base = best;
+        printf("%8d%12.4f%10.2f%10.2f%10.2f%8ld\n", threads, best,
+               2.0 * n * sizeof(int) / best / 1e9, base / best,
+               base / best / threads, pool.steals / repeat);
+        fflush(stdout);
+        if (threads == max_threads)
+            break;
+        threads = threads * 2 < max_threads ? threads * 2 : max_threads;
+    }
+    stop_pool();
+    free(A);
+    free(B);
+    return 0;
+}
@@ -0,0 +1,465 @@
+/*
+ * simpoint.c - Reduces a long trace to a few representative intervals,
+ * in the spirit of SimPoint.
+ *
+ * The trace is cut into intervals of a fixed number of data accesses.
+ * Each interval gets a signature: a histogram of the blocks it touches,
+ * hashed down to a few dimensions, next to a histogram of the distance
+ * between consecutive blocks on a log scale, which tells a sequential
+ * sweep from a strided one over the same data. The signatures are clustered with
+ * k-means for every k up to a limit. The smallest k that gets most of
+ * the way to the best clustering is kept, and the interval closest to
+ * the centre of each cluster stands in for all of its members.
+ *
+ * The representatives are written back to back as one binary trace,
+ * each preceded by the accesses just before it as a warm-up prefix, and
+ * described by <out>.points. csim --points replays them and scales the
+ * counts up to estimate the whole trace:
+ *
+ *     linux> ./simpoint -t big.trace -o big.sp
+ *     linux> ./csim -s 10 -E 8 -b 6 -t big.sp --points big.sp.points
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include "cachelab.h"
+
+/* Signature dimensions: blocks are hashed into BLOCK_DIMS buckets, and
+   the log2 distance to the previous block fills the rest */
+#define DIM_BITS 5
+#define BLOCK_DIMS (1 << DIM_BITS)
+#define STRIDE_DIMS 16
+#define DIMS (BLOCK_DIMS + STRIDE_DIMS)
+
+/* Output buffer size in records */
+#define OUTBUF (1 << 16)
+
+/* Lloyd iterations per clustering */
+#define MAX_ITER 30
+
+/* Mean squared distance to the centres below which splitting further
+   buys nothing, as when every interval looks alike */
+#define MIN_SPREAD 1e-4
+
+/* Command line settings */
+static char* trace_name = NULL;
+static char* out_name = NULL;
+static unsigned long long interval = 1000000;
+static unsigned long long warm = 0;     /* default: one interval */
+static int max_k = 10;
+static int block_bits = 6;
+static double pick = 0.9;               /* share of the best improvement to reach */
+static unsigned long long seed = 1;
+
+/* One signature per interval, grown as the trace is read */
+static float* sigs;
+static unsigned long long* lengths;
+static int intervals = 0;
+
+static FILE* out;
+static unsigned long long buf[OUTBUF];
+static int buf_len = 0;
+
+/*
+ * next_rand - xorshift64* generator, as in tracesynth
+ */
+static unsigned long long next_rand(void)
+{
+    seed ^= seed >> 12;
+    seed ^= seed << 25;
+    seed ^= seed >> 27;
+    return seed * 2685821657736338717ULL;
+}
+
+/*
+ * open_trace - Open a text or binary trace, leaving it at the first record
+ */
+static FILE* open_trace(int* binary)
+{
+    char magic[BINARY_TRACE_MAGIC_LEN];
+    FILE* t = fopen(trace_name, "r");
+    if (t == NULL) {
+        perror(trace_name);
+        exit(1);
+    }
+    *binary = fread(magic, 1, BINARY_TRACE_MAGIC_LEN, t) == BINARY_TRACE_MAGIC_LEN &&
+        memcmp(magic, BINARY_TRACE_MAGIC, BINARY_TRACE_MAGIC_LEN) == 0;
+    if (!*binary)
+        rewind(t);
+    return t;
+}
+
+/*
+ * next_record - Read the next data access, skipping instruction fetches
+ * the way csim does. Returns 0 at the end of the trace.
+ */
+static int next_record(FILE* t, int binary, char* op, unsigned long long* addr)
+{
+    char line[256];
+    char* p;
+
+    if (binary) {
+        unsigned long long rec;
+        if (fread(&rec, sizeof(rec), 1, t) != 1)
+            return 0;
+        *op = TRACE_OP(rec);
+        *addr = TRACE_ADDR(rec);
+        return 1;
+    }
+    while (fgets(line, sizeof(line), t) != NULL) {
+        for (p = line; *p == ' '; p++)
+            ;
+        if (*p == 'I' || *p == '\0' || *p == '\n')
+            continue;
+        *op = *p++;
+        *addr = strtoull(p, NULL, 16);
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * add_interval - Start a new, empty signature
+ */
+static void add_interval(void)
+{
+    if ((intervals & (intervals - 1)) == 0) {
+        int cap = intervals ? 2 * intervals : 1;
+        sigs = realloc(sigs, (size_t) cap * DIMS * sizeof(float));
+        lengths = realloc(lengths, cap * sizeof(unsigned long long));
+        if (sigs == NULL || lengths == NULL) {
+            fprintf(stderr, "simpoint: out of memory for signatures\n");
+            exit(1);
+        }
+    }
+    memset(sigs + (size_t) intervals * DIMS, 0, DIMS * sizeof(float));
+    lengths[intervals++] = 0;
+}
+
+/*
+ * stride_bucket - log2 of the distance between two blocks, 0 for the same
+ * block, capped at the last bucket
+ */
+static int stride_bucket(unsigned long long blk, unsigned long long prev)
+{
+    unsigned long long delta = blk > prev ? blk - prev : prev - blk;
+    int bucket = 0;
+    while (delta && bucket < STRIDE_DIMS - 1) {
+        delta >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+/*
+ * read_signatures - First pass: one signature per interval, each half
+ * normalized so intervals of different lengths compare fairly
+ */
+static void read_signatures(void)
+{
+    int binary, i, d;
+    char op;
+    unsigned long long addr, prev = 0;
+    FILE* t = open_trace(&binary);
+
+    while (next_record(t, binary, &op, &addr)) {
+        unsigned long long blk = addr >> block_bits;
+        float* sig;
+        if (intervals == 0 || lengths[intervals - 1] == interval)
+            add_interval();
+        sig = sigs + (size_t)(intervals - 1) * DIMS;
+        sig[(blk * 0x9E3779B97F4A7C15ULL) >> (64 - DIM_BITS)] += 1;
+        sig[BLOCK_DIMS + stride_bucket(blk, prev)] += 1;
+        prev = blk;
+        lengths[intervals - 1]++;
+    }
+    fclose(t);
+    for (i = 0; i < intervals; i++)
+        for (d = 0; d < DIMS; d++)
+            sigs[(size_t) i * DIMS + d] /= lengths[i];
+}
+
+static double dist(const float* a, const float* b)
+{
+    double sum = 0;
+    int d;
+    for (d = 0; d < DIMS; d++)
+        sum += (double)(a[d] - b[d]) * (a[d] - b[d]);
+    return sum;
+}
+
+/*
+ * kmeans - Cluster the signatures into k groups, seeded k-means++ style.
+ * Fills assign[] and centres[] and returns the total squared distance.
+ */
+static double kmeans(int k, int* assign, float* centres)
+{
+    double* near = malloc(intervals * sizeof(double));
+    int* count = malloc(k * sizeof(int));
+    double total = 0;
+    int i, c, d, iter, changed = 1;
+
+    if (near == NULL || count == NULL) {
+        fprintf(stderr, "simpoint: out of memory for clustering\n");
+        exit(1);
+    }
+    /* Each new centre is an interval picked with probability proportional
+       to its squared distance from the centres so far */
+    memcpy(centres, sigs + (next_rand() % intervals) * DIMS, DIMS * sizeof(float));
+    for (c = 1; c <= k; c++) {
+        total = 0;
+        for (i = 0; i < intervals; i++) {
+            double dd = dist(sigs + (size_t) i * DIMS, centres + (c - 1) * DIMS);
+            if (c == 1 || dd < near[i])
+                near[i] = dd;
+            total += near[i];
+        }
+        if (c == k)
+            break;
+        double u = (next_rand() >> 11) * (1.0 / 9007199254740992.0) * total;
+        for (i = 0; i < intervals - 1 && u >= near[i]; i++)
+            u -= near[i];
+        memcpy(centres + c * DIMS, sigs + (size_t) i * DIMS, DIMS * sizeof(float));
+    }
+
+    for (i = 0; i < intervals; i++)
+        assign[i] = -1;
+    for (iter = 0; iter < MAX_ITER && changed; iter++) {
+        changed = 0;
+        total = 0;
+        for (i = 0; i < intervals; i++) {
+            int best = 0;
+            double best_d = dist(sigs + (size_t) i * DIMS, centres);
+            for (c = 1; c < k; c++) {
+                double dd = dist(sigs + (size_t) i * DIMS, centres + c * DIMS);
+                if (dd < best_d) {
+                    best_d = dd;
+                    best = c;
+                }
+            }
+            if (assign[i] != best) {
+                assign[i] = best;
+                changed = 1;
+            }
+            total += best_d;
+        }
+        memset(centres, 0, (size_t) k * DIMS * sizeof(float));
+        memset(count, 0, k * sizeof(int));
+        for (i = 0; i < intervals; i++) {
+            count[assign[i]]++;
+            for (d = 0; d < DIMS; d++)
+                centres[assign[i] * DIMS + d] += sigs[(size_t) i * DIMS + d];
+        }
+        for (c = 0; c < k; c++)
+            for (d = 0; d < DIMS; d++)
+                if (count[c])
+                    centres[c * DIMS + d] /= count[c];
+    }
+    free(near);
+    free(count);
+    return total;
+}
+
+/*
+ * flush_buf - Write out the buffered records
+ */
+static void flush_buf(void)
+{
+    fwrite(buf, sizeof(buf[0]), buf_len, out);
+    buf_len = 0;
+}
+
+static void emit(unsigned long long rec)
+{
+    if (buf_len == OUTBUF)
+        flush_buf();
+    buf[buf_len++] = rec;
+}
+
+/*
+ * write_points - Second pass: copy each representative interval and the
+ * warm-up accesses before it. The last `warm` records are kept in a ring
+ * so a prefix can reach back into the previous representative.
+ */
+static void write_points(const int* rep, int k, const double* weight, unsigned long long total)
+{
+    unsigned long long* ring = malloc((warm ? warm : 1) * sizeof(unsigned long long));
+    unsigned long long pos = 0, start, j;
+    int binary, i, m, next = 0;
+    char op, name[512];
+    unsigned long long addr;
+    int* order = malloc(k * sizeof(int));
+    FILE* t = open_trace(&binary);
+    FILE* points;
+
+    snprintf(name, sizeof(name), "%s.points", out_name);
+    out = fopen(out_name, "wb");
+    points = fopen(name, "w");
+    if (ring == NULL || order == NULL || out == NULL || points == NULL) {
+        fprintf(stderr, "simpoint: could not write %s or %s\n", out_name, name);
+        exit(1);
+    }
+    fwrite(BINARY_TRACE_MAGIC, 1, BINARY_TRACE_MAGIC_LEN, out);
+    fprintf(points, "# accesses:%llu intervals:%d interval-length:%llu clusters:%d\n",
+            total, intervals, interval, k);
+    fprintf(points, "# start warm length weight\n");
+
+    /* Representatives in trace order */
+    for (i = 0; i < k; i++)
+        order[i] = i;
+    for (i = 1; i < k; i++)
+        for (m = i; m > 0 && rep[order[m - 1]] > rep[order[m]]; m--) {
+            int tmp = order[m];
+            order[m] = order[m - 1];
+            order[m - 1] = tmp;
+        }
+
+    while (next < k && next_record(t, binary, &op, &addr)) {
+        unsigned long long rec = TRACE_RECORD(op, addr);
+        start = (unsigned long long) rep[order[next]] * interval;
+        if (pos == start) {
+            unsigned long long have = pos < warm ? pos : warm;
+            for (j = pos - have; j < pos; j++)
+                emit(ring[j % warm]);
+            fprintf(points, "%llu %llu %llu %.6f\n", start, have,
+                    lengths[rep[order[next]]], weight[order[next]]);
+        }
+        if (pos >= start && pos < start + lengths[rep[order[next]]])
+            emit(rec);
+        if (pos + 1 == start + lengths[rep[order[next]]])
+            next++;
+        if (warm)
+            ring[pos % warm] = rec;
+        pos++;
+    }
+    flush_buf();
+    fclose(t);
+    fclose(out);
+    fclose(points);
+    free(ring);
+    free(order);
+}
+
+/*
+ * usage - Print usage info
+ */
+static void usage(char* argv[])
+{
+    printf("Usage: %s [-h] -t <trace> -o <out> [options]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -t <file>     Trace to reduce, text or binary\n");
+    printf("  -o <file>     Reduced binary trace; the intervals go to <file>.points\n");
+    printf("  -i <count>    Accesses per interval (default 1000000)\n");
+    printf("  -w <count>    Warm-up accesses before each interval (default one interval)\n");
+    printf("  -k <max>      Most clusters to try (default 10)\n");
+    printf("  -b <bits>     Block offset bits for the signatures (default 6)\n");
+    printf("  -p <frac>     Keep the smallest k reaching this share of the best\n");
+    printf("                clustering's improvement over k=1 (default 0.9)\n");
+    printf("  -r <seed>     Random seed (default 1)\n");
+    printf("Example: %s -t big.trace -o big.sp -i 100000\n", argv[0]);
+}
+
+int main(int argc, char* argv[])
+{
+    int c, i, k, chosen = 1;
+    unsigned long long total = 0, kept = 0;
+
+    while ((c = getopt(argc, argv, "t:o:i:w:k:b:p:r:h")) != -1) {
+        switch (c) {
+        case 't': trace_name = optarg; break;
+        case 'o': out_name = optarg; break;
+        case 'i': interval = strtoull(optarg, NULL, 10); break;
+        case 'w': warm = strtoull(optarg, NULL, 10); break;
+        case 'k': max_k = atoi(optarg); break;
+        case 'b': block_bits = atoi(optarg); break;
+        case 'p': pick = atof(optarg); break;
+        case 'r': seed = strtoull(optarg, NULL, 10); break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+    if (trace_name == NULL || out_name == NULL) {
+        printf("Error: Missing required argument\n");
+        usage(argv);
+        exit(1);
+    }
+    if (interval == 0 || max_k < 1 || block_bits < 0 || block_bits > 63) {
+        printf("Error: interval and -k must be positive, -b between 0 and 63\n");
+        exit(1);
+    }
+    if (warm == 0)
+        warm = interval;
+    if (seed == 0)
+        seed = 1; /* xorshift never leaves zero */
+
+    read_signatures();
+    if (intervals == 0) {
+        printf("Error: %s has no data accesses\n", trace_name);
+        exit(1);
+    }
+    for (i = 0; i < intervals; i++)
+        total += lengths[i];
+    if (max_k > intervals)
+        max_k = intervals;
+
+    /* Cluster for every k, then keep the smallest k that gets within
+       `pick` of the improvement the largest k achieves, or that leaves
+       the intervals close to their centres anyway */
+    int* assign = malloc((size_t) max_k * intervals * sizeof(int));
+    float* centres = malloc((size_t) max_k * max_k * DIMS * sizeof(float));
+    double* cost = malloc((max_k + 1) * sizeof(double));
+    if (assign == NULL || centres == NULL || cost == NULL) {
+        fprintf(stderr, "simpoint: out of memory for clustering\n");
+        exit(1);
+    }
+    for (k = 1; k <= max_k; k++)
+        cost[k] = kmeans(k, assign + (size_t)(k - 1) * intervals,
+                         centres + (size_t)(k - 1) * max_k * DIMS);
+    for (k = max_k; k >= 1; k--)
+        if (cost[1] - cost[k] >= pick * (cost[1] - cost[max_k]) ||
+            cost[k] <= MIN_SPREAD * intervals)
+            chosen = k;
+
+    /* The member nearest each centre represents the cluster, weighted by
+       how many accesses the cluster covers per access it replays */
+    int* members = assign + (size_t)(chosen - 1) * intervals;
+    float* centre = centres + (size_t)(chosen - 1) * max_k * DIMS;
+    int* rep = malloc(chosen * sizeof(int));
+    double* best = malloc(chosen * sizeof(double));
+    double* weight = calloc(chosen, sizeof(double));
+    int found = 0;
+    if (rep == NULL || best == NULL || weight == NULL) {
+        fprintf(stderr, "simpoint: out of memory\n");
+        exit(1);
+    }
+    for (c = 0; c < chosen; c++)
+        rep[c] = -1;
+    for (i = 0; i < intervals; i++) {
+        double dd = dist(sigs + (size_t) i * DIMS, centre + members[i] * DIMS);
+        c = members[i];
+        if (rep[c] < 0 || dd < best[c]) {
+            rep[c] = i;
+            best[c] = dd;
+        }
+        weight[c] += lengths[i];
+    }
+    /* Clusters k-means left empty are dropped */
+    for (c = 0; c < chosen; c++) {
+        if (rep[c] < 0)
+            continue;
+        rep[found] = rep[c];
+        weight[found] = weight[c] / lengths[rep[c]];
+        kept += lengths[rep[c]];
+        found++;
+    }
+    write_points(rep, found, weight, total);
+
+    printf("intervals:%d clusters:%d accesses:%llu measured:%llu (%.2f%%) warm-up:%llu per interval\n",
+           intervals, found, total, kept, 100.0 * kept / total, warm);
+    return 0;
+}
@@ -3,6 +3,7 @@
  *     student's transpose functions and records the results for their
  *     official submitted version as well.
  */
+#define _POSIX_C_SOURCE 200809L /* clock_gettime under -std=c99 */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -14,6 +15,7 @@
 #include "cachelab.h"
 #include <sys/wait.h> // fir WEXITSTATUS
 #include <limits.h> // for INT_MAX
+#include <time.h>
 
 /* Maximum array dimension */
 #define MAXN 256
@@ -25,13 +27,33 @@
 /* External function defined in trans.c */
 extern void registerFunctions();
 
+/* External function defined in kernels.c */
+extern void registerKernels();
+
 /* External variables defined in cachelab-tools.c */
 extern trans_func_t func_list[MAX_TRANS_FUNCS];
 extern int func_counter; 
+extern kernel_t kernel_list[MAX_KERNELS];
+extern int kernel_counter;
 
 /* Globals set on the command line */
 static int M = 0;
 static int N = 0;
+static int attribute = 0; /* -r: per-region attribution with ./csim */
+static int kernels = 0;   /* -k: also evaluate the registered kernels */
+static char* latency = NULL; /* -l: latency model passed to ./csim --latency */
+static int profile = 0;      /* -p: time the steps of each evaluation */
+static char* diff = NULL;    /* -d: pair of functions whose misses ./csim compares */
+
+/* Estimated cycles and AMAT per function, filled in when -l is given */
+struct estimate {
+    char* name;
+    int correct;
+    double cycles;
+    double amat;
+};
+static struct estimate func_est[MAX_TRANS_FUNCS];
+static struct estimate kernel_est[MAX_KERNELS];
 
 /* The correctness and performance for the submitted transpose function */
 struct results {
@@ -42,22 +64,207 @@ struct results {
 static struct results results = {-1, 0, INT_MAX};
 
 /* 
- * eval_perf - Evaluate the performance of the registered transpose functions
+ * now - Seconds on a monotonic clock
  */
-void eval_perf(unsigned int s, unsigned int E, unsigned int b)
+static double now(void)
 {
-    int i,flag;
-    unsigned int len, hits, misses, evictions;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * trace_and_score - Trace the function tracegen runs with `select` (for
+ *     example "-F 3"), keep the accesses between the markers in filename
+ *     and score them with the reference simulator. Returns 0 if tracegen
+ *     reported a validation error.
+ */
+int trace_and_score(const char* select, const char* filename,
+                    unsigned int s, unsigned int E, unsigned int b,
+                    unsigned int* hits, unsigned int* misses,
+                    unsigned int* evictions)
+{
+    int flag;
+    unsigned int len;
     unsigned long long int marker_start, marker_end, addr;
     char buf[1000], cmd[255];
-    char filename[128];
-
-    registerFunctions(); 
+    char config[64], key[RESULT_KEY_LEN];
+    int stored;
+    long stored_hits, stored_misses, stored_evictions;
+    double start = now(), traced, filtered;
 
     /* Open the complete trace file */
     FILE* full_trace_fp;  
     FILE* part_trace_fp; 
 
+    printf("Step 1: Validating and generating memory traces\n");
+    /* Use valgrind to generate the trace */
+
+    sprintf(cmd, "valgrind --tool=lackey --trace-mem=yes --log-fd=1 -v ./tracegen -M %d -N %d %s  > trace.tmp", M, N, select);
+    flag=WEXITSTATUS(system(cmd));
+    if (0!=flag) {
+        printf("Validation error at function %d! Run ./tracegen -M %d -N %d %s for details.\nSkipping performance evaluation for this function.\n",flag-1,M,N,select);      
+        return 0;
+    }
+    traced = now();
+
+    /* Get the start and end marker addresses */
+    FILE* marker_fp = fopen(".marker", "r");
+    assert(marker_fp);
+    fscanf(marker_fp, "%llx %llx", &marker_start, &marker_end);
+    fclose(marker_fp);
+
+    full_trace_fp = fopen("trace.tmp", "r");
+    assert(full_trace_fp);
+
+
+    /* Filtered trace for each function goes in a separate file */
+    part_trace_fp = fopen(filename, "w");
+    assert(part_trace_fp);
+    
+    /* Locate trace corresponding to the function */
+    flag = 0;
+    while (fgets(buf, 1000, full_trace_fp) != NULL) {
+
+        /* We are only interested in memory access instructions */
+        if (buf[0]==' ' && buf[2]==' ' &&
+            (buf[1]=='S' || buf[1]=='M' || buf[1]=='L' )) {
+            sscanf(buf+3, "%llx,%u", &addr, &len);
+        
+            /* If start marker found, set flag */
+            if (addr == marker_start)
+                flag = 1;
+
+            /* Valgrind creates many spurious accesses to the
+               stack that have nothing to do with the students
+               code. At the moment, we are ignoring all stack
+               accesses by using the simple filter of recording
+               accesses to only the low 32-bit portion of the
+               address space. At some point it would be nice to
+               try to do more informed filtering so that would
+               eliminate the valgrind stack references while
+               include the student stack references. */
+            if (flag && addr < 0xffffffff) {
+                fputs(buf, part_trace_fp);
+            }
+
+            /* if end marker found, close trace file */
+            if (addr == marker_end) {
+                flag = 0;
+                fclose(part_trace_fp);
+                break;
+            }
+        }
+    }
+    fclose(full_trace_fp);
+    filtered = now();
+
+    /* Keep this run's regions with its trace, since csim --diff needs
+       both sides' matrix addresses */
+    sprintf(cmd, "%s.regions", filename);
+    rename(".regions", cmd);
+
+    /* Run the reference simulator, unless the result store already
+       has this exact trace and configuration */
+    printf("Step 2: Evaluating performance (s=%d, E=%d, b=%d)\n", s, E, b);
+    sprintf(config, "s=%u E=%u b=%u", s, E, b);
+    stored = resultKey(filename, config, "csim-ref", key) == 0 &&
+        loadResult(key, &stored_hits, &stored_misses, &stored_evictions);
+    if (stored) {
+        *hits = stored_hits;
+        *misses = stored_misses;
+        *evictions = stored_evictions;
+    } else {
+        sprintf(cmd, "./csim-ref -s %u -E %u -b %u -t %s > /dev/null", 
+                s, E, b, filename);
+        system(cmd);
+    
+        /* Collect results from the reference simulator */
+        FILE* in_fp = fopen(".csim_results","r");
+        assert(in_fp);
+        fscanf(in_fp, "%u %u %u", hits, misses, evictions);
+        fclose(in_fp);
+        if (resultKey(filename, config, "csim-ref", key) == 0)
+            saveResult(key, *hits, *misses, *evictions);
+    }
+    if (profile)
+        printf("profile trace-sec:%.3f filter-sec:%.3f sim-sec:%.3f%s\n",
+               traced - start, filtered - traced, now() - filtered,
+               stored ? " (stored)" : "");
+
+    /* Break the counts down by data structure using the regions
+       tracegen recorded */
+    if (attribute) {
+        sprintf(cmd, "./csim -s %u -E %u -b %u -t %s --regions %s.regions"
+                " | grep -v '^trace'", s, E, b, filename, filename);
+        system(cmd);
+    }
+    return 1;
+}
+
+/*
+ * estimate_cycles - Run ./csim with the latency model on a filtered trace
+ *     and read back its cycle estimate. Returns 0 if csim gave none.
+ */
+int estimate_cycles(const char* filename, unsigned int s, unsigned int E,
+                    unsigned int b, struct estimate* est)
+{
+    char cmd[512], line[256];
+    int found = 0;
+    FILE* fp;
+
+    sprintf(cmd, "./csim -s %u -E %u -b %u -t %s --latency %s > .csim_latency",
+            s, E, b, filename, latency);
+    system(cmd);
+    fp = fopen(".csim_latency", "r");
+    if (fp == NULL)
+        return 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "latency cycles:%lf stall-cycles:%*f writebacks:%*d amat:%lf",
+                   &est->cycles, &est->amat) == 2)
+            found = 1;
+    }
+    fclose(fp);
+    if (found)
+        printf("estimated cycles:%.0f amat:%.2f\n", est->cycles, est->amat);
+    return found;
+}
+
+/*
+ * print_ranking - List the correct functions from fastest to slowest
+ *     estimated time
+ */
+void print_ranking(const char* what, struct estimate* est, int count)
+{
+    int i, j, best;
+    char used[MAX_TRANS_FUNCS > MAX_KERNELS ? MAX_TRANS_FUNCS : MAX_KERNELS] = {0};
+
+    printf("\n%s ranked by estimated cycles (%s):\n", what, latency);
+    for (i = 0; i < count; i++) {
+        best = -1;
+        for (j = 0; j < count; j++)
+            if (!used[j] && est[j].correct &&
+                (best < 0 || est[j].cycles < est[best].cycles))
+                best = j;
+        if (best < 0)
+            break;
+        used[best] = 1;
+        printf("%3d. %-40s cycles:%.0f amat:%.2f\n", i + 1,
+               est[best].name, est[best].cycles, est[best].amat);
+    }
+}
+
+/* 
+ * eval_perf - Evaluate the performance of the registered transpose functions
+ */
+void eval_perf(unsigned int s, unsigned int E, unsigned int b)
+{
+    int i;
+    unsigned int hits, misses, evictions;
+    char select[32], filename[128];
+
+    registerFunctions(); 
+
     /* Evaluate the performance of each registered transpose function */
 
     for (i=0; i<func_counter; i++) {
@@ -65,22 +272,11 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b)
             results.funcid = i; /* remember which function is the submission */
 
 
-        printf("\nFunction %d (%d total)\nStep 1: Validating and generating memory traces\n",i,func_counter);
-        /* Use valgrind to generate the trace */
-
-        sprintf(cmd, "valgrind --tool=lackey --trace-mem=yes --log-fd=1 -v ./tracegen -M %d -N %d -F %d  > trace.tmp", M, N,i);
-        flag=WEXITSTATUS(system(cmd));
-        if (0!=flag) {
-            printf("Validation error at function %d! Run ./tracegen -M %d -N %d -F %d for details.\nSkipping performance evaluation for this function.\n",flag-1,M,N,i);      
+        printf("\nFunction %d (%d total)\n",i,func_counter);
+        sprintf(select, "-F %d", i);
+        sprintf(filename, "trace.f%d", i);
+        if (!trace_and_score(select, filename, s, E, b, &hits, &misses, &evictions))
             continue;
-        }
-
-        /* Get the start and end marker addresses */
-        FILE* marker_fp = fopen(".marker", "r");
-        assert(marker_fp);
-        fscanf(marker_fp, "%llx %llx", &marker_start, &marker_end);
-        fclose(marker_fp);
-
 
         func_list[i].correct=1;
 
@@ -89,86 +285,106 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b)
             results.correct = 1;
         }
 
-        full_trace_fp = fopen("trace.tmp", "r");
-        assert(full_trace_fp);
-
-
-        /* Filtered trace for each transpose function goes in a separate file */
-        sprintf(filename, "trace.f%d", i);
-        part_trace_fp = fopen(filename, "w");
-        assert(part_trace_fp);
-    
-        /* Locate trace corresponding to the trans function */
-        flag = 0;
-        while (fgets(buf, 1000, full_trace_fp) != NULL) {
-
-            /* We are only interested in memory access instructions */
-            if (buf[0]==' ' && buf[2]==' ' &&
-                (buf[1]=='S' || buf[1]=='M' || buf[1]=='L' )) {
-                sscanf(buf+3, "%llx,%u", &addr, &len);
-        
-                /* If start marker found, set flag */
-                if (addr == marker_start)
-                    flag = 1;
-
-                /* Valgrind creates many spurious accesses to the
-                   stack that have nothing to do with the students
-                   code. At the moment, we are ignoring all stack
-                   accesses by using the simple filter of recording
-                   accesses to only the low 32-bit portion of the
-                   address space. At some point it would be nice to
-                   try to do more informed filtering so that would
-                   eliminate the valgrind stack references while
-                   include the student stack references. */
-                if (flag && addr < 0xffffffff) {
-                    fputs(buf, part_trace_fp);
-                }
-
-                /* if end marker found, close trace file */
-                if (addr == marker_end) {
-                    flag = 0;
-                    fclose(part_trace_fp);
-                    break;
-                }
-            }
-        }
-        fclose(full_trace_fp);
-
-        /* Run the reference simulator */
-        printf("Step 2: Evaluating performance (s=%d, E=%d, b=%d)\n", s, E, b);
-        char cmd[255];
-        sprintf(cmd, "./csim-ref -s %u -E %u -b %u -t trace.f%d > /dev/null", 
-                s, E, b, i);
-        system(cmd);
-    
-        /* Collect results from the reference simulator */
-        FILE* in_fp = fopen(".csim_results","r");
-        assert(in_fp);
-        fscanf(in_fp, "%u %u %u", &hits, &misses, &evictions);
-        fclose(in_fp);
         func_list[i].num_hits = hits;
         func_list[i].num_misses = misses;
         func_list[i].num_evictions = evictions;
-        printf("func %u (%s): hits:%u, misses:%u, evictions:%u\n",
-               i, func_list[i].description, hits, misses, evictions);
-    
+        printf("func %u (%s%s): hits:%u, misses:%u, evictions:%u\n",
+               i, func_list[i].description,
+               func_list[i].inplace_ptr ? ", in place" : "",
+               hits, misses, evictions);
+
+        if (latency) {
+            func_est[i].name = func_list[i].description;
+            func_est[i].correct = estimate_cycles(filename, s, E, b, &func_est[i]);
+        }
+
         /* If it is transpose_submit(), record number of misses */
         if (results.funcid == i) {
             results.misses = misses;
         }
     }
+    if (latency)
+        print_ranking("Functions", func_est, func_counter);
   
 }
 
+/* 
+ * eval_kernels - Evaluate the performance of the registered kernels
+ */
+void eval_kernels(unsigned int s, unsigned int E, unsigned int b)
+{
+    int i;
+    unsigned int hits, misses, evictions;
+    char select[32], filename[128];
+
+    registerKernels();
+
+    for (i=0; i<kernel_counter; i++) {
+        printf("\nKernel %d (%d total)\n",i,kernel_counter);
+        sprintf(select, "-K %d", i);
+        sprintf(filename, "trace.k%d", i);
+        if (!trace_and_score(select, filename, s, E, b, &hits, &misses, &evictions))
+            continue;
+
+        kernel_list[i].correct=1;
+        kernel_list[i].num_hits = hits;
+        kernel_list[i].num_misses = misses;
+        kernel_list[i].num_evictions = evictions;
+        printf("kernel %u (%s): hits:%u, misses:%u, evictions:%u\n",
+               i, kernel_list[i].description, hits, misses, evictions);
+        if (latency) {
+            kernel_est[i].name = kernel_list[i].description;
+            kernel_est[i].correct = estimate_cycles(filename, s, E, b, &kernel_est[i]);
+        }
+    }
+    if (latency)
+        print_ranking("Kernels", kernel_est, kernel_counter);
+}
+
+/*
+ * eval_diff - Compare the miss streams of two transpose functions, given
+ *     as "<i>:<j>", with ./csim --diff on the traces eval_perf left behind
+ */
+void eval_diff(unsigned int s, unsigned int E, unsigned int b)
+{
+    int i, j;
+    char cmd[255];
+
+    if (sscanf(diff, "%d:%d", &i, &j) != 2 || i < 0 || j < 0 ||
+        i >= func_counter || j >= func_counter) {
+        printf("Error: -d wants two function numbers below %d, like 0:1\n", func_counter);
+        return;
+    }
+    /* only a validated function's trace is current, an older one may be stale */
+    if (!func_list[i].correct || !func_list[j].correct) {
+        printf("Error: func %d failed validation, so it can't be compared\n",
+               func_list[i].correct ? j : i);
+        return;
+    }
+    printf("\nComparing func %d (%s) with func %d (%s):\n",
+           i, func_list[i].description, j, func_list[j].description);
+    fflush(stdout);
+    sprintf(cmd, "./csim -s %u -E %u -b %u -t trace.f%d --diff trace.f%d",
+            s, E, b, i, j);
+    system(cmd);
+    printf("\n");
+}
+
 /*
  * usage - Print usage info
  */
 void usage(char *argv[]){
-    printf("Usage: %s [-h] -M <rows> -N <cols>\n", argv[0]);
+    printf("Usage: %s [-h] [-r] [-k] [-p] [-l <latency>] [-d <i>:<j>] -M <rows> -N <cols>\n", argv[0]);
     printf("Options:\n");
     printf("  -h          Print this help message.\n");
     printf("  -M <rows>   Number of matrix rows (max %d)\n", MAXN);
     printf("  -N <cols>   Number of  matrix columns (max %d)\n", MAXN);
+    printf("  -r          Attribute hits, misses and evictions to A, B and the stack.\n");
+    printf("  -k          Also evaluate the kernels registered in kernels.c.\n");
+    printf("  -l <hit>:<mem>[:<wb>[:<mlp>]]  Estimate cycles and AMAT with ./csim's\n");
+    printf("              latency model and rank the functions by them.\n");
+    printf("  -p          Report the time spent tracing, filtering and simulating.\n");
+    printf("  -d <i>:<j>  Show where funcs i and j miss differently (tiles, sets, evictors).\n");
     printf("Example: %s -M 8 -N 8\n", argv[0]);       
 }
 
@@ -199,7 +415,7 @@ int main(int argc, char* argv[])
 {
     char c;
 
-    while ((c = getopt(argc,argv,"M:N:h")) != -1) {
+    while ((c = getopt(argc,argv,"M:N:rkl:pd:h")) != -1) {
         switch(c) {
         case 'M':
             M = atoi(optarg);
@@ -207,6 +423,21 @@ int main(int argc, char* argv[])
         case 'N':
             N = atoi(optarg);
             break;
+        case 'r':
+            attribute = 1;
+            break;
+        case 'k':
+            kernels = 1;
+            break;
+        case 'l':
+            latency = optarg;
+            break;
+        case 'p':
+            profile = 1;
+            break;
+        case 'd':
+            diff = optarg;
+            break;
         case 'h':
             usage(argv);
             exit(0);
@@ -244,6 +475,10 @@ int main(int argc, char* argv[])
 
     /* Check the performance of the student's transpose function */
     eval_perf(5, 1, 5);
+    if (diff)
+        eval_diff(5, 1, 5);
+    if (kernels)
+        eval_kernels(5, 1, 5);
   
     /* Emit the results for this particular test */
     if (results.funcid == -1) {
@@ -4,7 +4,8 @@
  * 
  * The beginning and end of each registered transpose function's trace
  * is indicated by reading from "marker" addresses. These two marker
- * addresses are recorded in file for later use.
+ * addresses are recorded in file for later use, and the address ranges
+ * of A, B and the stack are recorded in .regions.
  */
 
 #include <stdlib.h>
@@ -18,15 +19,26 @@
 /* External variables declared in cachelab.c */
 extern trans_func_t func_list[MAX_TRANS_FUNCS];
 extern int func_counter; 
+extern kernel_t kernel_list[MAX_KERNELS];
+extern int kernel_counter;
 
 /* External function from trans.c */
 extern void registerFunctions();
 
+/* External function from kernels.c */
+extern void registerKernels();
+
 /* Markers used to bound trace regions of interest */
 volatile char MARKER_START, MARKER_END;
 
+/* Bytes below main's frame treated as the stack region */
+#define STACK_WINDOW (64 * 1024)
+
 static int A[256][256];
 static int B[256][256];
+static int Orig[256][256]; /* A before an in-place transpose */
+static int Args[MAX_KERNEL_ARGS][256 * 256]; /* kernel arguments */
+static int Ref[MAX_KERNEL_ARGS][256 * 256];  /* reference outputs */
 static int M;
 static int N;
 
@@ -46,12 +58,83 @@ int validate(int fn,int M, int N, int A[N][M], int B[M][N]) {
     return 1;
 }
 
+/*
+ * runFunction - Run one registered function between the markers and
+ * validate it. In-place functions get A alone; A is restored afterwards
+ * so the next function sees the original matrix.
+ */
+int runFunction(int fn) {
+    trans_func_t* f = &func_list[fn];
+    int ok;
+    if (f->inplace_ptr == NULL) {
+        MARKER_START = 33;
+        (*f->func_ptr)(M, N, A, B);
+        MARKER_END = 34;
+        return validate(fn, M, N, A, B);
+    }
+    memcpy(Orig, A, sizeof(A));
+    MARKER_START = 33;
+    (*f->inplace_ptr)(M, N, &A[0][0]);
+    MARKER_END = 34;
+    ok = validate(fn, M, N, Orig, A); /* A now holds M rows of N */
+    memcpy(A, Orig, sizeof(A));
+    return ok;
+}
+
+/*
+ * runKernel - Fill the inputs of kernel k, run it between the markers
+ * and compare each output with what the reference computes from the
+ * same inputs
+ */
+int runKernel(int k) {
+    kernel_t* kern = &kernel_list[k];
+    void* args[MAX_KERNEL_ARGS];
+    void* refArgs[MAX_KERNEL_ARGS];
+    int a, i, n, bound;
+
+    /* Index arguments point into the first argument */
+    bound = kernelArgSize(&kern->args[0], M, N);
+    srand(k + 1);
+    for (a = 0; a < kern->num_args; a++) {
+        n = kernelArgSize(&kern->args[a], M, N);
+        for (i = 0; i < n; i++) {
+            if (kern->args[a].kind == KARG_INDEX)
+                Args[a][i] = rand() % bound;
+            else
+                Args[a][i] = rand() % 1024; /* small enough not to overflow */
+        }
+        memcpy(Ref[a], Args[a], n * sizeof(int));
+        args[a] = Args[a];
+        refArgs[a] = kern->args[a].kind == KARG_OUT ? Ref[a] : Args[a];
+    }
+
+    MARKER_START = 33;
+    (*kern->func_ptr)(M, N, args);
+    MARKER_END = 34;
+
+    (*kern->ref_ptr)(M, N, refArgs);
+    for (a = 0; a < kern->num_args; a++) {
+        if (kern->args[a].kind != KARG_OUT)
+            continue;
+        n = kernelArgSize(&kern->args[a], M, N);
+        for (i = 0; i < n; i++) {
+            if (Args[a][i] != Ref[a][i]) {
+                printf("Validation failed on kernel %d! Expected %d but got %d at %s[%d]\n",
+                       k, Ref[a][i], Args[a][i], kern->args[a].name, i);
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
 int main(int argc, char* argv[]){
-    int i;
+    int i, rows, cols;
 
     char c;
     int selectedFunc=-1;
-    while( (c=getopt(argc,argv,"M:N:F:")) != -1){
+    int selectedKernel=-1;
+    while( (c=getopt(argc,argv,"M:N:F:K:")) != -1){
         switch(c){
         case 'M':
             M = atoi(optarg);
@@ -62,6 +145,9 @@ int main(int argc, char* argv[]){
         case 'F':
             selectedFunc = atoi(optarg);
             break;
+        case 'K':
+            selectedKernel = atoi(optarg);
+            break;
         case '?':
         default:
             printf("./tracegen failed to parse its options.\n");
@@ -70,8 +156,13 @@ int main(int argc, char* argv[]){
     }
   
 
-    /*  Register transpose functions */
+    /*  Register transpose functions and kernels */
     registerFunctions();
+    registerKernels();
+    if (selectedKernel >= kernel_counter) {
+        printf("./tracegen: no kernel %d\n", selectedKernel);
+        exit(1);
+    }
 
     /* Fill A with data */
     initMatrix(M,N, A, B); 
@@ -84,20 +175,47 @@ int main(int argc, char* argv[]){
             (unsigned long long int) &MARKER_END );
     fclose(marker_fp);
 
-    if (-1==selectedFunc) {
+    /* Record the data structure address ranges for csim --regions, with
+       each matrix's rows and columns so csim --diff can name elements.
+       Only the first N*M ints of each static matrix are used. The stack range
+       is approximate: the transpose frames sit just below main's, so a
+       window below this local covers their temporaries. */
+    FILE* regions_fp = fopen(".regions","w");
+    assert(regions_fp);
+    if (selectedKernel >= 0) {
+        /* Kernels name their own arguments */
+        for (i = 0; i < kernel_list[selectedKernel].num_args; i++) {
+            kernelArgShape(&kernel_list[selectedKernel].args[i], M, N, &rows, &cols);
+            fprintf(regions_fp, "%s %llx %llx %d %d\n",
+                    kernel_list[selectedKernel].args[i].name,
+                    (unsigned long long int) Args[i],
+                    (unsigned long long int) Args[i] + sizeof(int) * rows * cols,
+                    rows, cols);
+        }
+    } else {
+        fprintf(regions_fp, "A %llx %llx %d %d\n",
+                (unsigned long long int) &A[0][0],
+                (unsigned long long int) &A[0][0] + sizeof(int) * M * N, N, M);
+        fprintf(regions_fp, "B %llx %llx %d %d\n",
+                (unsigned long long int) &B[0][0],
+                (unsigned long long int) &B[0][0] + sizeof(int) * M * N, M, N);
+    }
+    fprintf(regions_fp, "stack %llx %llx\n",
+            (unsigned long long int) &i - STACK_WINDOW,
+            (unsigned long long int) &i + sizeof(i));
+    fclose(regions_fp);
+
+    if (selectedKernel >= 0) {
+        if (!runKernel(selectedKernel))
+            return selectedKernel+1;
+    } else if (-1==selectedFunc) {
         /* Invoke registered transpose functions */
         for (i=0; i < func_counter; i++) {
-            MARKER_START = 33;
-            (*func_list[i].func_ptr)(M, N, A, B);
-            MARKER_END = 34;
-            if (!validate(i,M,N,A,B))
+            if (!runFunction(i))
                 return i+1;
         }
     } else {
-        MARKER_START = 33;
-        (*func_list[selectedFunc].func_ptr)(M, N, A, B);
-        MARKER_END = 34;
-        if (!validate(selectedFunc,M,N,A,B))
+        if (!runFunction(selectedFunc))
             return selectedFunc+1;
 
     }
@@ -0,0 +1,305 @@
+/*
+ * tracesynth.c - Writes large synthetic memory traces for controlled
+ * access patterns, either as valgrind lackey style text that every tool
+ * here reads, or as a compact binary format that csim reads directly.
+ *
+ * Every pattern is driven by a fixed-seed generator, so the same command
+ * line always produces the same trace.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+#include "cachelab.h"
+
+/* Output buffer size */
+#define OUTBUF (1 << 20)
+
+/* Command line settings */
+static char* pattern = "seq";
+static unsigned long long count = 1000000;
+static unsigned long long base = 0x10000000;
+static unsigned long long wset = 1 << 23;   /* working set in bytes */
+static unsigned long long stride = 64;
+static unsigned int elem = 4;               /* element size in bytes */
+static unsigned long long rows = 1024, cols = 1024, tile = 8;
+static double zipf_alpha = 0.99;
+static double store_frac = 0.25;
+static unsigned long long seed = 1;
+static int binary = 0;
+
+static FILE* out;
+static char buf[OUTBUF];
+static size_t buf_len = 0;
+static unsigned long long written = 0;
+
+/*
+ * next_rand - xorshift64* generator
+ */
+static unsigned long long next_rand(void)
+{
+    seed ^= seed >> 12;
+    seed ^= seed << 25;
+    seed ^= seed >> 27;
+    return seed * 2685821657736338717ULL;
+}
+
+/* Uniform double in [0,1) */
+static double next_unit(void)
+{
+    return (next_rand() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void flush_buf(void)
+{
+    fwrite(buf, 1, buf_len, out);
+    buf_len = 0;
+}
+
+/*
+ * emit - Append one access. Text records are formatted by hand because
+ * fprintf dominates the cost of writing multi-gigabyte traces.
+ */
+static void emit(unsigned long long addr)
+{
+    char op = next_unit() < store_frac ? 'S' : 'L';
+    if (buf_len + 64 > OUTBUF)
+        flush_buf();
+    if (binary) {
+        unsigned long long rec = TRACE_RECORD(op, addr);
+        memcpy(buf + buf_len, &rec, sizeof(rec));
+        buf_len += sizeof(rec);
+    } else {
+        char hex[16];
+        int n = 0;
+        buf[buf_len++] = ' ';
+        buf[buf_len++] = op;
+        buf[buf_len++] = ' ';
+        do {
+            hex[n++] = "0123456789abcdef"[addr & 0xf];
+            addr >>= 4;
+        } while (addr);
+        while (n)
+            buf[buf_len++] = hex[--n];
+        buf_len += sprintf(buf + buf_len, ",%u\n", elem);
+    }
+    written++;
+}
+
+static int done(void)
+{
+    return written >= count;
+}
+
+/* Walk the working set one element at a time, wrapping around */
+static void gen_seq(void)
+{
+    unsigned long long off = 0;
+    while (!done()) {
+        emit(base + off);
+        off = (off + elem) % wset;
+    }
+}
+
+/* Walk the working set with a fixed stride, shifting by one element per pass */
+static void gen_stride(void)
+{
+    unsigned long long off = 0, pass = 0;
+    while (!done()) {
+        emit(base + off);
+        off += stride;
+        if (off >= wset) {
+            pass = (pass + elem) % stride;
+            off = pass;
+        }
+    }
+}
+
+/* Uniformly random elements of the working set */
+static void gen_uniform(void)
+{
+    unsigned long long n = wset / elem;
+    while (!done())
+        emit(base + (next_rand() % n) * elem);
+}
+
+/*
+ * gen_zipf - Elements drawn from a Zipf(alpha) distribution over the
+ * working set. Ranks are scattered with a fixed permutation-like multiply
+ * so the hot elements are not all adjacent.
+ */
+static void gen_zipf(void)
+{
+    unsigned long long n = wset / elem, i;
+    double* cdf = malloc(n * sizeof(double));
+    double sum = 0;
+    if (cdf == NULL) {
+        fprintf(stderr, "tracesynth: working set too large for zipf\n");
+        exit(1);
+    }
+    for (i = 0; i < n; i++) {
+        sum += 1.0 / pow(i + 1, zipf_alpha);
+        cdf[i] = sum;
+    }
+    while (!done()) {
+        double u = next_unit() * sum;
+        unsigned long long lo = 0, hi = n - 1;
+        while (lo < hi) {
+            unsigned long long mid = (lo + hi) / 2;
+            if (cdf[mid] < u)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        emit(base + ((lo * 0x9E3779B1ULL) % n) * elem);
+    }
+    free(cdf);
+}
+
+/*
+ * gen_chase - Pointer chasing: nodes of `stride` bytes linked in a single
+ * random cycle (Sattolo's algorithm), each visit loads the next pointer.
+ */
+static void gen_chase(void)
+{
+    unsigned long long n = wset / stride, i, cur = 0;
+    unsigned long long* next = malloc(n * sizeof(unsigned long long));
+    if (next == NULL || n < 2) {
+        fprintf(stderr, "tracesynth: bad working set for chase\n");
+        exit(1);
+    }
+    for (i = 0; i < n; i++)
+        next[i] = i;
+    for (i = n - 1; i > 0; i--) {
+        unsigned long long j = next_rand() % i, t = next[i];
+        next[i] = next[j];
+        next[j] = t;
+    }
+    while (!done()) {
+        emit(base + cur * stride);
+        cur = next[cur];
+    }
+    free(next);
+}
+
+/* A rows x cols matrix walked row by row, then column by column, or in tiles */
+static void gen_matrix(int order)
+{
+    unsigned long long i, j, bi, bj;
+    while (!done()) {
+        if (order == 'r') {
+            for (i = 0; i < rows && !done(); i++)
+                for (j = 0; j < cols && !done(); j++)
+                    emit(base + (i * cols + j) * elem);
+        } else if (order == 'c') {
+            for (j = 0; j < cols && !done(); j++)
+                for (i = 0; i < rows && !done(); i++)
+                    emit(base + (i * cols + j) * elem);
+        } else {
+            for (bi = 0; bi < rows && !done(); bi += tile)
+                for (bj = 0; bj < cols && !done(); bj += tile)
+                    for (i = bi; i < bi + tile && i < rows && !done(); i++)
+                        for (j = bj; j < bj + tile && j < cols && !done(); j++)
+                            emit(base + (i * cols + j) * elem);
+        }
+    }
+}
+
+/*
+ * usage - Print usage info
+ */
+static void usage(char* argv[])
+{
+    printf("Usage: %s [-h] -p <pattern> [options]\n", argv[0]);
+    printf("Patterns: seq stride uniform zipf chase rowmajor colmajor tiled\n");
+    printf("Options:\n");
+    printf("  -p <pattern>  Access pattern (default seq)\n");
+    printf("  -n <count>    Number of accesses (default 1000000)\n");
+    printf("  -o <file>     Output file (default stdout)\n");
+    printf("  -B            Write the binary format instead of text\n");
+    printf("  -w <bytes>    Working set size (default 8MB)\n");
+    printf("  -a <addr>     Base address in hex (default 10000000)\n");
+    printf("  -e <bytes>    Element size (default 4)\n");
+    printf("  -d <bytes>    Stride for stride, node size for chase (default 64)\n");
+    printf("  -M <rows>     Matrix rows (default 1024)\n");
+    printf("  -N <cols>     Matrix columns (default 1024)\n");
+    printf("  -T <size>     Tile edge for tiled (default 8)\n");
+    printf("  -z <alpha>    Zipf exponent (default 0.99)\n");
+    printf("  -f <frac>     Fraction of stores (default 0.25)\n");
+    printf("  -r <seed>     Random seed (default 1)\n");
+    printf("Example: %s -p zipf -n 100000000 -B -o zipf.bin\n", argv[0]);
+}
+
+int main(int argc, char* argv[])
+{
+    int c;
+    char* outname = NULL;
+
+    while ((c = getopt(argc, argv, "p:n:o:Bw:a:e:d:M:N:T:z:f:r:h")) != -1) {
+        switch (c) {
+        case 'p': pattern = optarg; break;
+        case 'n': count = strtoull(optarg, NULL, 10); break;
+        case 'o': outname = optarg; break;
+        case 'B': binary = 1; break;
+        case 'w': wset = strtoull(optarg, NULL, 10); break;
+        case 'a': base = strtoull(optarg, NULL, 16); break;
+        case 'e': elem = atoi(optarg); break;
+        case 'd': stride = strtoull(optarg, NULL, 10); break;
+        case 'M': rows = strtoull(optarg, NULL, 10); break;
+        case 'N': cols = strtoull(optarg, NULL, 10); break;
+        case 'T': tile = strtoull(optarg, NULL, 10); break;
+        case 'z': zipf_alpha = atof(optarg); break;
+        case 'f': store_frac = atof(optarg); break;
+        case 'r': seed = strtoull(optarg, NULL, 10); break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+    /* an empty matrix or a working set of no whole elements never emits */
+    if (elem == 0 || stride == 0 || tile == 0 || rows == 0 || cols == 0 || wset / elem == 0) {
+        printf("Error: element, stride, tile, rows, cols and working set must be positive\n");
+        exit(1);
+    }
+    if (seed == 0)
+        seed = 1; /* xorshift never leaves zero */
+
+    out = outname ? fopen(outname, "wb") : stdout;
+    if (out == NULL) {
+        perror(outname);
+        exit(1);
+    }
+    if (binary)
+        fwrite(BINARY_TRACE_MAGIC, 1, BINARY_TRACE_MAGIC_LEN, out);
+
+    if (strcmp(pattern, "seq") == 0)
+        gen_seq();
+    else if (strcmp(pattern, "stride") == 0)
+        gen_stride();
+    else if (strcmp(pattern, "uniform") == 0)
+        gen_uniform();
+    else if (strcmp(pattern, "zipf") == 0)
+        gen_zipf();
+    else if (strcmp(pattern, "chase") == 0)
+        gen_chase();
+    else if (strcmp(pattern, "rowmajor") == 0)
+        gen_matrix('r');
+    else if (strcmp(pattern, "colmajor") == 0)
+        gen_matrix('c');
+    else if (strcmp(pattern, "tiled") == 0)
+        gen_matrix('t');
+    else {
+        printf("Error: unknown pattern %s\n", pattern);
+        usage(argv);
+        exit(1);
+    }
+
+    flush_buf();
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}